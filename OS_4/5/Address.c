@@ -0,0 +1,163 @@
+#define _DEFAULT_SOURCE
+#include "Address.h"
+#include "HashSet.h"  /* for HashInt() */
+#include <stdio.h>    /* for sprintf() */
+#include <stdlib.h>   /* for strtol() */
+#include <string.h>   /* for memset() and strncmp() */
+#include <stddef.h>   /* for offsetof() */
+
+// Length of the name of a Unix-domain address
+#define UnixNameLen(addr) ((int)(addr)->len - (int)offsetof(struct sockaddr_un, sun_path))
+
+static int ParseUnix(const char *path, Address *addr)
+{
+    int pathLen = strlen(path);
+    if (pathLen == 0 || pathLen >= (int)sizeof(addr->un.sun_path))
+        return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->un.sun_family = AF_UNIX;
+    memcpy(addr->un.sun_path, path, pathLen + 1);
+    addr->len = offsetof(struct sockaddr_un, sun_path) + pathLen + 1;
+    return 1;
+}
+
+static int ParseShm(const char *name, Address *addr)
+{
+    int nameLen = strlen(name);
+    if (nameLen == 0 || nameLen >= SHM_NAME_MAX)
+        return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->shm.shm_family = AF_SHM;
+    addr->shm.shm_slot = -1;
+    memcpy(addr->shm.shm_name, name, nameLen + 1);
+    addr->len = sizeof(addr->shm);
+    return 1;
+}
+
+static int ParsePort(const char *str, unsigned short *port)
+{
+    char *end;
+    long value = strtol(str, &end, 10);
+    if (*str == '\0' || *end != '\0' || value < 0 || value > 65535)
+        return 0;
+    *port = value;
+    return 1;
+}
+
+int AddressFromArgs(char **args, int count, Address *addr)
+{
+    if (count < 1)
+        return 0;
+    if (strncmp(args[0], UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+        return ParseUnix(args[0] + strlen(UNIX_PREFIX), addr) ? 1 : 0;
+    if (strncmp(args[0], SHM_PREFIX, strlen(SHM_PREFIX)) == 0)
+        return ParseShm(args[0] + strlen(SHM_PREFIX), addr) ? 1 : 0;
+
+    unsigned short port;
+    if (count < 2 || !ParsePort(args[1], &port))
+        return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->in.sin_family = AF_INET;
+    if (inet_aton(args[0], &addr->in.sin_addr) == 0)
+        return 0;
+    addr->in.sin_port = htons(port);
+    addr->len = sizeof(addr->in);
+    return 2;
+}
+
+int AddressParse(const char *str, Address *addr)
+{
+    if (strncmp(str, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0 || strncmp(str, SHM_PREFIX, strlen(SHM_PREFIX)) == 0)
+        return AddressFromArgs((char **)&str, 1, addr);
+
+    // Split "IP:PORT" into the two arguments
+    char host[INET_ADDRSTRLEN];
+    const char *colon = strrchr(str, ':');
+    if (!colon || colon - str >= (int)sizeof(host))
+        return 0;
+    memcpy(host, str, colon - str);
+    host[colon - str] = '\0';
+
+    char *args[2] = {host, (char *)colon + 1};
+    return AddressFromArgs(args, 2, addr) == 2;
+}
+
+int AddressParseLocal(const char *str, Address *addr)
+{
+    if (strncmp(str, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+        return ParseUnix(str + strlen(UNIX_PREFIX), addr);
+    if (strncmp(str, SHM_PREFIX, strlen(SHM_PREFIX)) == 0)
+        return ParseShm(str + strlen(SHM_PREFIX), addr);
+
+    unsigned short port;
+    if (!ParsePort(str, &port))
+        return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->in.sin_family = AF_INET;
+    addr->in.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr->in.sin_port = htons(port);
+    addr->len = sizeof(addr->in);
+    return 1;
+}
+
+unsigned int AddressHash(const Address *addr)
+{
+    if (addr->sa.sa_family == AF_INET)
+        return HashInt(addr->in.sin_addr.s_addr ^ ((unsigned int)addr->in.sin_port << 16));
+    if (addr->sa.sa_family == AF_SHM)
+        return HashInt(addr->shm.shm_slot ^ (addr->shm.shm_generation << 8));
+
+    // FNV-1a over the socket name
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < UnixNameLen(addr); ++i)
+        hash = (hash ^ (unsigned char)addr->un.sun_path[i]) * 16777619u;
+    return hash;
+}
+
+int AddressEqual(const Address *a1, const Address *a2)
+{
+    if (a1->sa.sa_family != a2->sa.sa_family)
+        return 0;
+    if (a1->sa.sa_family == AF_INET)
+        return a1->in.sin_addr.s_addr == a2->in.sin_addr.s_addr && a1->in.sin_port == a2->in.sin_port;
+    if (a1->sa.sa_family == AF_SHM)
+        return a1->shm.shm_slot == a2->shm.shm_slot && a1->shm.shm_generation == a2->shm.shm_generation;
+    return a1->len == a2->len && memcmp(a1->un.sun_path, a2->un.sun_path, UnixNameLen(a1)) == 0;
+}
+
+int AddressFromServer(const Address *server, const Address *from)
+{
+    if (server->sa.sa_family == AF_INET)
+        return from->sa.sa_family == AF_INET && server->in.sin_addr.s_addr == from->in.sin_addr.s_addr;
+    if (server->sa.sa_family == AF_SHM)
+        return from->sa.sa_family == AF_SHM;
+    return AddressEqual(server, from);
+}
+
+void AddressFormat(const Address *addr, char *str)
+{
+    if (addr->sa.sa_family == AF_INET)
+    {
+        sprintf(str, "%s:%d", inet_ntoa(addr->in.sin_addr), ntohs(addr->in.sin_port));
+        return;
+    }
+    if (addr->sa.sa_family == AF_SHM)
+    {
+        if (addr->shm.shm_slot < 0)
+            sprintf(str, "%s%s", SHM_PREFIX, addr->shm.shm_name);
+        else
+            sprintf(str, "%s#%d.%u", SHM_PREFIX, addr->shm.shm_slot, addr->shm.shm_generation);
+        return;
+    }
+
+    // Abstract names start with a null byte and are not null-terminated
+    int nameLen = UnixNameLen(addr);
+    if (nameLen > 0 && addr->un.sun_path[0] == '\0')
+        sprintf(str, "%s@%.*s", UNIX_PREFIX, nameLen - 1, addr->un.sun_path + 1);
+    else
+        sprintf(str, "%s%.*s", UNIX_PREFIX, nameLen, addr->un.sun_path);
+}
@@ -0,0 +1,65 @@
+#ifndef ADDRESS_H
+#define ADDRESS_H
+
+#include <sys/socket.h> /* for sockaddr and socklen_t */
+#include <sys/un.h>     /* for sockaddr_un */
+#include <arpa/inet.h>  /* for sockaddr_in */
+
+// Endpoint of a datagram socket: an IP address with a UDP port, or a Unix-domain
+// socket written as "unix:PATH" for the processes running on the same host as the
+// server. Unix-domain clients are bound to autobind names which are shown as "@NAME".
+// "shm:NAME" is the shared-memory segment of a server (see Shm.h), its workers are
+// known to the server by their slot in the segment.
+
+#define UNIX_PREFIX "unix:"
+#define SHM_PREFIX "shm:"
+#define ADDRLEN 120 /* Longest formatted address */
+
+#define AF_SHM AF_MAX     /* Shared-memory transport, not a socket family */
+#define SHM_NAME_MAX 64   /* Longest segment name, including the null byte */
+
+struct sockaddr_shm
+{
+    sa_family_t shm_family;      // AF_SHM
+    int shm_slot;                // slot of a worker, -1 for the server
+    unsigned shm_generation;     // tells apart the workers which have used the slot
+    char shm_name[SHM_NAME_MAX]; // segment of the server
+};
+
+typedef struct Address
+{
+    union
+    {
+        struct sockaddr sa;
+        struct sockaddr_in in; // AF_INET
+        struct sockaddr_un un; // AF_UNIX
+        struct sockaddr_shm shm; // AF_SHM
+    };
+    socklen_t len; // length of the used part of the union
+} Address;
+
+// Parses the server address given to a client: "unix:PATH", "shm:NAME" or "IP PORT".
+// Returns the number of arguments used, 0 if they are missing or invalid.
+int AddressFromArgs(char **args, int count, Address *addr);
+
+// Parses an address written as one word: "IP:PORT", "unix:PATH" or "shm:NAME", the
+// form AddressFormat() writes. Returns 0 if it is invalid.
+int AddressParse(const char *str, Address *addr);
+
+// Parses the local endpoint of the server: "unix:PATH", "shm:NAME" or a UDP port
+// on any interface. Returns 0 if it is invalid.
+int AddressParseLocal(const char *str, Address *addr);
+
+// Addresses are compared by family, IP and port, socket name, or slot and generation
+unsigned int AddressHash(const Address *addr);
+int AddressEqual(const Address *a1, const Address *a2);
+
+// Checks if a datagram from 'from' comes from the server at 'server': the same IP,
+// any port, or the same Unix-domain socket. Shared memory has no foreign senders.
+int AddressFromServer(const Address *server, const Address *from);
+
+// Writes "IP:PORT", "unix:PATH", "unix:@NAME", "shm:NAME" or "shm:#SLOT.GENERATION"
+// to str, which holds ADDRLEN bytes
+void AddressFormat(const Address *addr, char *str);
+
+#endif
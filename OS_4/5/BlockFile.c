@@ -0,0 +1,77 @@
+#include "BlockFile.h"
+
+// Bits needed by the largest offset from the smallest ID
+static int BlockWidth(const int *ids, int count, unsigned *base)
+{
+    unsigned min = ids[0], max = ids[0];
+    for (int i = 1; i < count; ++i)
+    {
+        if ((unsigned)ids[i] < min)
+            min = ids[i];
+        if ((unsigned)ids[i] > max)
+            max = ids[i];
+    }
+
+    int width = 0;
+    while (width < 32 && (max - min) >> width)
+        ++width;
+    *base = min;
+    return width;
+}
+
+int BlockEncodedLen(const int *ids, int count)
+{
+    unsigned base;
+    int width = BlockWidth(ids, count, &base);
+    return BLOCK_HEADER_LEN + (count * width + 7) / 8;
+}
+
+int BlockEncode(unsigned char *block, const int *ids, int count)
+{
+    unsigned base;
+    int width = BlockWidth(ids, count, &base);
+
+    for (int i = 0; i < 4; ++i)
+        block[i] = base >> (8 * i);
+    block[4] = width;
+
+    // Bits are appended to the accumulator and flushed a byte at a time
+    unsigned char *out = block + BLOCK_HEADER_LEN;
+    unsigned long acc = 0;
+    int bits = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        acc |= (unsigned long)((unsigned)ids[i] - base) << bits;
+        bits += width;
+        while (bits >= 8)
+        {
+            *out++ = acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0)
+        *out++ = acc;
+
+    return out - block;
+}
+
+int BlockDecode(const unsigned char *block, int i)
+{
+    unsigned base = block[0] | block[1] << 8 | block[2] << 16 | (unsigned)block[3] << 24;
+    int width = block[4];
+    if (width == 0)
+        return base;
+
+    // Only the bytes holding the i-th offset are read
+    long bit = (long)i * width;
+    const unsigned char *data = block + BLOCK_HEADER_LEN + bit / 8;
+    int shift = bit % 8;
+    int bytes = (shift + width + 7) / 8;
+    unsigned long acc = 0;
+    for (int j = 0; j < bytes; ++j)
+        acc |= (unsigned long)data[j] << (8 * j);
+
+    unsigned long mask = width == 32 ? 0xffffffffUL : (1UL << width) - 1;
+    return base + (unsigned)((acc >> shift) & mask);
+}
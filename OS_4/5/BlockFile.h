@@ -0,0 +1,50 @@
+#ifndef BLOCKFILE_H
+#define BLOCKFILE_H
+
+// Binary library file: the IDs in the order of the positions, cut into
+// blocks of BLOCK_BOOKS. A block stores its smallest ID and the others as
+// offsets from it packed into as few bits as the largest one needs (frame of
+// reference), so one book is read without decoding the rest.
+//
+// The format gives random access, not compression. Frame of reference only
+// saves bits when the IDs of a block are close together. The IDs of Generator
+// are spread over 2^31, so a block takes about 31 bits per book, 3.98 bytes
+// with the headers and the table. That is no smaller than plain 4-byte IDs.
+// No encoding does much better, because random IDs carry about 31 bits each.
+// The file is 5 times smaller than the 20-byte text lines only because the
+// IDs are binary and the positions are implied by the order.
+//
+// Layout: the header, the table of blockCount + 1 file offsets where the blocks
+// start (the last one is the end of the file), the blocks. A block is the base
+// ID (4 bytes, little-endian), the bit width (1 byte) and the packed offsets,
+// least significant bits first.
+
+#define BLOCK_FILE_MAGIC "LIBBLK1" /* With its '\0', the first 8 bytes of the file */
+#define BLOCK_BOOKS 128
+#define BLOCK_HEADER_LEN 5
+#define BLOCK_MAX_LEN (BLOCK_HEADER_LEN + BLOCK_BOOKS * 4)
+
+typedef struct BlockFileHeader
+{
+    char magic[8];
+    int firstRow, lastRow; // rows of the file
+    int N, K;              // shelves per row, books per shelf
+    long blockCount;
+} BlockFileHeader;
+
+// Offset of the first block, after the header and the table
+static inline long BlockFileDataStart(long blockCount)
+{
+    return sizeof(BlockFileHeader) + (blockCount + 1) * sizeof(long);
+}
+
+// Size of the block holding the IDs, all of them must be non-negative
+int BlockEncodedLen(const int *ids, int count);
+
+// Writes the block, returns its size
+int BlockEncode(unsigned char *block, const int *ids, int count);
+
+// Reads the i-th ID of the block
+int BlockDecode(const unsigned char *block, int i);
+
+#endif
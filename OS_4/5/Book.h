@@ -12,4 +12,10 @@ typedef struct Book
 Book * BookCreate(int id, int m, int n, int k);
 int BookCompare(const void *, const void *);
 
+// Order by ID, for the containers which inline the comparison
+static inline int BookLess(const Book *b1, const Book *b2)
+{
+    return b1->id < b2->id;
+}
+
 #endif
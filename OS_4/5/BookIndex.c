@@ -0,0 +1,366 @@
+#define _DEFAULT_SOURCE
+
+#include "BookIndex.h"
+#include "BlockFile.h"
+#include "Codec.h"
+#include <stdlib.h>     /* for malloc() */
+#include <string.h>     /* for memset() and memchr() */
+#include <limits.h>     /* for INT_MAX */
+#include <fcntl.h>      /* for open() */
+#include <unistd.h>     /* for close() */
+#include <pthread.h>    /* for pthread_create() */
+#include <sys/mman.h>   /* for mmap() */
+#include <sys/stat.h>   /* for fstat() */
+#ifdef __SSE2__
+#include <emmintrin.h>  /* for the SSE2 intrinsics */
+#endif
+
+#define BLOCK 16                 /* Bytes classified at once */
+#define MIN_CHUNK_SIZE (1 << 20) /* Smaller files are not worth another thread */
+#define MAX_LOAD_THREADS 64
+#define LINE_MAX_LEN 64          /* Four ints and their delimiters */
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// Part of the file parsed by one thread, it starts and ends at line boundaries
+typedef struct Chunk
+{
+    BookIndex *index;
+    const char *begin, *end;
+    int *ids; // slice of the index cleared by the thread before the parsing
+    long idCount;
+    long books;
+    int valid;
+} Chunk;
+
+// Marks the delimiters (':' and '\n') of the block and sets *bad to the bytes
+// which are neither delimiters nor digits, bit i stands for byte i
+static inline unsigned ClassifyBlock(const char *p, int len, unsigned *bad)
+{
+#ifdef __SSE2__
+    if (len == BLOCK)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        __m128i delims = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(':')),
+                                      _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+        // Signed compares: the bytes above 127 are negative, so not digits
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                       _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+        unsigned delimMask = _mm_movemask_epi8(delims);
+        *bad = ~(delimMask | _mm_movemask_epi8(digits)) & 0xFFFF;
+        return delimMask;
+    }
+#endif
+    unsigned delimMask = 0, badMask = 0;
+    for (int i = 0; i < len; ++i)
+    {
+        if (p[i] == ':' || p[i] == '\n')
+            delimMask |= 1u << i;
+        else if ((unsigned)(p[i] - '0') > 9)
+            badMask |= 1u << i;
+    }
+    *bad = badMask;
+    return delimMask;
+}
+
+// Converts a run of digits, whose end is already known
+static inline int FieldValue(const char *p, int len, int *value)
+{
+    if (len == 0 || len > 10)
+        return 0;
+    unsigned long v = 0;
+    for (int i = 0; i < len; ++i)
+    {
+        v = v * 10 + (unsigned)(p[i] - '0');
+    }
+    if (v > INT_MAX)
+        return 0;
+    *value = (int)v;
+    return 1;
+}
+
+// Stores the "M:N:K:ID" fields, returns 0 if the position is outside the index
+static inline int StoreBook(BookIndex *index, const int *fields)
+{
+    int m = fields[0], n = fields[1], k = fields[2];
+    if (m < index->rows.first || m > index->rows.last || n >= index->N || k >= index->K)
+        return 0;
+    index->ids[((long)(m - index->rows.first) * index->N + n) * index->K + k] = fields[3];
+    return 1;
+}
+
+static void *ClearChunk(void *arg)
+{
+    Chunk *chunk = arg;
+    // All bytes 0xFF make BOOK_INDEX_EMPTY
+    memset(chunk->ids, 0xFF, chunk->idCount * sizeof(*chunk->ids));
+    return NULL;
+}
+
+static void *ParseChunk(void *arg)
+{
+    Chunk *chunk = arg;
+    int fields[4];
+    int field = 0;
+    const char *fieldStart = chunk->begin;
+
+    chunk->valid = 0;
+    chunk->books = 0;
+
+    for (const char *p = chunk->begin; p < chunk->end; p += BLOCK)
+    {
+        int len = chunk->end - p < BLOCK ? chunk->end - p : BLOCK;
+        unsigned bad;
+        unsigned delims = ClassifyBlock(p, len, &bad);
+        if (bad)
+            return NULL;
+
+        // Every delimiter ends a field, the newline ends the line
+        while (delims)
+        {
+            const char *delim = p + __builtin_ctz(delims);
+            delims &= delims - 1;
+
+            if (*delim == '\n' && field == 0 && delim == fieldStart)
+            {
+                fieldStart = delim + 1; // empty line
+                continue;
+            }
+            if ((*delim == '\n') != (field == 3) || !FieldValue(fieldStart, delim - fieldStart, &fields[field]))
+                return NULL;
+            fieldStart = delim + 1;
+
+            if (field < 3)
+            {
+                field += 1;
+                continue;
+            }
+            field = 0;
+            if (!StoreBook(chunk->index, fields))
+                return NULL;
+            chunk->books += 1;
+        }
+    }
+
+    // The last line of the file may lack its newline
+    if (field > 0 || fieldStart < chunk->end)
+    {
+        if (field != 3 || !FieldValue(fieldStart, chunk->end - fieldStart, &fields[3]) ||
+            !StoreBook(chunk->index, fields))
+            return NULL;
+        chunk->books += 1;
+    }
+
+    chunk->valid = 1;
+    return NULL;
+}
+
+// Parses the line from begin to end (without its newline), returns 0 if it is invalid
+static int ParseLine(const char *begin, const char *end, int *fields)
+{
+    char line[LINE_MAX_LEN + 1];
+    const char *rest;
+
+    if (end - begin > LINE_MAX_LEN)
+        return 0;
+    memcpy(line, begin, end - begin);
+    line[end - begin] = '\0';
+    return CodecParseFields(line, ':', fields, 4, &rest) == 4 && *rest == '\0';
+}
+
+// Runs the work on the chunks, on the calling thread if there is a single one
+static void RunChunks(void *(*work)(void *), Chunk *chunks, int count)
+{
+    pthread_t threads[MAX_LOAD_THREADS];
+
+    if (count == 1)
+    {
+        work(&chunks[0]);
+        return;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, work, &chunks[i]) != 0)
+            DieWithError("pthread_create() failed");
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static long LoadText(BookIndex *index, const char *text, long size, int threadCount)
+{
+    // The first and the last lines give the size of the index
+    const char *end = text + size;
+    while (end > text && end[-1] == '\n')
+        --end;
+    if (end == text)
+        return 0;
+    const char *firstEnd = memchr(text, '\n', end - text);
+    const char *lastBegin = end;
+    while (lastBegin > text && lastBegin[-1] != '\n')
+        --lastBegin;
+
+    int first[4], last[4];
+    if (!ParseLine(text, firstEnd ? firstEnd : end, first) || !ParseLine(lastBegin, end, last) ||
+        first[0] > last[0])
+        return -1;
+
+    index->rows.first = first[0];
+    index->rows.last = last[0];
+    index->N = last[1] + 1;
+    index->K = last[2] + 1;
+    long idCount = (long)(index->rows.last - index->rows.first + 1) * index->N * index->K;
+    index->ids = malloc(idCount * sizeof(*index->ids));
+    if (!index->ids)
+        DieWithError("malloc() failed");
+
+    int count = size / MIN_CHUNK_SIZE;
+    if (count > threadCount)
+        count = threadCount;
+    if (count > MAX_LOAD_THREADS)
+        count = MAX_LOAD_THREADS;
+    if (count < 1)
+        count = 1;
+
+    // Split the text evenly, moving each boundary past the end of its line
+    Chunk chunks[MAX_LOAD_THREADS];
+    const char *begin = text;
+    for (int i = 0; i < count; ++i)
+    {
+        const char *chunkEnd = i == count - 1 ? text + size : text + size * (i + 1) / count;
+        if (chunkEnd < begin)
+            chunkEnd = begin;
+        if (chunkEnd < text + size && chunkEnd > text && chunkEnd[-1] != '\n')
+        {
+            const char *newline = memchr(chunkEnd, '\n', text + size - chunkEnd);
+            chunkEnd = newline ? newline + 1 : text + size;
+        }
+
+        chunks[i].index = index;
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        chunks[i].ids = index->ids + idCount * i / count;
+        chunks[i].idCount = idCount * (i + 1) / count - idCount * i / count;
+        begin = chunkEnd;
+    }
+
+    RunChunks(ClearChunk, chunks, count);
+    RunChunks(ParseChunk, chunks, count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!chunks[i].valid)
+        {
+            BookIndexFree(index);
+            return -1;
+        }
+        index->books += chunks[i].books;
+    }
+    return index->books;
+}
+
+// Checks the header, the block table and the block headers of the block
+// file, so that no lookup reads past its block
+static long MapBlocks(BookIndex *index, const unsigned char *map, long size)
+{
+    BlockFileHeader header;
+    memcpy(&header, map, sizeof(header));
+
+    if (header.N <= 0 || header.K <= 0 || header.firstRow < 0 || header.lastRow < header.firstRow)
+        return -1;
+    long books = (long)(header.lastRow - header.firstRow + 1) * header.N * header.K;
+    if (header.blockCount != (books + BLOCK_BOOKS - 1) / BLOCK_BOOKS || size < BlockFileDataStart(header.blockCount))
+        return -1;
+
+    const long *table = (const long *)(map + sizeof(header));
+    if (table[header.blockCount] != size)
+        return -1;
+    for (long b = 0; b < header.blockCount; ++b)
+    {
+        if (table[b] < BlockFileDataStart(header.blockCount) || table[b] + BLOCK_HEADER_LEN > table[b + 1])
+            return -1;
+        // The packed offsets of all the books of the block must fit
+        long count = books - b * BLOCK_BOOKS < BLOCK_BOOKS ? books - b * BLOCK_BOOKS : BLOCK_BOOKS;
+        int width = map[table[b] + 4];
+        if (width > 32 || table[b + 1] - table[b] < BLOCK_HEADER_LEN + (count * width + 7) / 8)
+            return -1;
+    }
+
+    index->rows.first = header.firstRow;
+    index->rows.last = header.lastRow;
+    index->N = header.N;
+    index->K = header.K;
+    index->map = map;
+    index->mapSize = size;
+    index->blockTable = table;
+    index->books = books;
+    return books;
+}
+
+long BookIndexLoad(BookIndex *index, const char *filename, int threadCount)
+{
+    struct stat st;
+
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        DieWithError("open() failed");
+    if (fstat(fd, &st) < 0)
+        DieWithError("fstat() failed");
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED)
+        DieWithError("mmap() failed");
+    close(fd);
+
+    if (st.st_size >= (long)sizeof(BlockFileHeader) && memcmp(text, BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC)) == 0)
+    {
+        // Lookups touch a block each
+        madvise((void *)text, st.st_size, MADV_RANDOM);
+        long books = MapBlocks(index, (const unsigned char *)text, st.st_size);
+        if (books < 0)
+            munmap((void *)text, st.st_size);
+        return books;
+    }
+
+    // The threads read their chunks in parallel, start reading all of them now
+    madvise((void *)text, st.st_size, MADV_WILLNEED);
+
+    long books = LoadText(index, text, st.st_size, threadCount);
+
+    munmap((void *)text, st.st_size);
+    return books;
+}
+
+int BookIndexFind(const BookIndex *index, const Position *pos, Book *book)
+{
+    if (pos->m < index->rows.first || pos->m > index->rows.last ||
+        pos->n < 0 || pos->n >= index->N || pos->k < 0 || pos->k >= index->K)
+        return 0;
+
+    long idx = ((long)(pos->m - index->rows.first) * index->N + pos->n) * index->K + pos->k;
+    int id = index->map ? BlockDecode(index->map + index->blockTable[idx / BLOCK_BOOKS], idx % BLOCK_BOOKS)
+                        : index->ids[idx];
+    if (id == BOOK_INDEX_EMPTY)
+        return 0;
+    book->id = id;
+    book->pos = *pos;
+    return 1;
+}
+
+void BookIndexFree(BookIndex *index)
+{
+    free(index->ids);
+    index->ids = NULL;
+    if (index->map)
+        munmap((void *)index->map, index->mapSize);
+    index->map = NULL;
+}
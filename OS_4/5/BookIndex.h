@@ -0,0 +1,37 @@
+#ifndef BOOKINDEX_H
+#define BOOKINDEX_H
+
+#include "Book.h"
+#include "RowRange.h"
+
+// Books of a library file held in memory: a dense array of IDs indexed by the
+// position, covering the rows of the file and all their shelves and books.
+// A text file is loaded in one go, its text parsed on several threads. A
+// block file (BlockFile.h) stays mapped and only the block holding the
+// position is decoded.
+
+#define BOOK_INDEX_EMPTY -1 /* ID of a position missing from the file */
+
+typedef struct BookIndex
+{
+    RowRange rows; // rows of the file
+    int N, K;      // shelves per row, books per shelf
+    int *ids;      // of the text file
+    long books;    // positions found in the file
+    const unsigned char *map; // the block file
+    long mapSize;
+    const long *blockTable;   // offsets of its blocks
+} BookIndex;
+
+// Loads the "M:N:K:ID" lines written by Generator, which come in the order of
+// the positions, using up to threadCount threads, or maps a block file.
+// Returns the number of books, 0 if the file is empty or -1 if it is not a
+// library file.
+long BookIndexLoad(BookIndex *index, const char *filename, int threadCount);
+
+// Looks the position up, returns 0 if the file does not hold it
+int BookIndexFind(const BookIndex *index, const Position *pos, Book *book);
+
+void BookIndexFree(BookIndex *index);
+
+#endif
@@ -0,0 +1,9 @@
+#include "Clock.h"
+#include <time.h>
+
+long ClockNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
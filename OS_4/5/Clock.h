@@ -0,0 +1,11 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#define NS_PER_MS 1000000L
+#define NS_PER_SEC 1000000000L
+
+// Monotonic time in nanoseconds. Clock.c reads the system clock,
+// SimClock.c provides the virtual clock of the simulator.
+long ClockNowNs();
+
+#endif
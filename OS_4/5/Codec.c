@@ -0,0 +1,103 @@
+#include "Codec.h"
+#include <limits.h> /* for INT_MAX */
+#include <string.h> /* for memcpy() */
+
+// Two digits at a time halve the divisions
+static const char digitPairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline int IsDigit(char c)
+{
+    return (unsigned)(c - '0') <= 9;
+}
+
+const char *CodecParseInt(const char *str, int *value)
+{
+    int negative = *str == '-';
+    str += negative;
+    if (!IsDigit(*str))
+        return NULL;
+
+    // INT_MIN has one more unit than INT_MAX
+    unsigned long limit = (unsigned long)INT_MAX + negative;
+    unsigned long acc = 0;
+    do
+    {
+        acc = acc * 10 + (unsigned)(*str++ - '0');
+        if (acc > limit)
+            return NULL;
+    } while (IsDigit(*str));
+
+    *value = negative ? (int)-(long)acc : (int)acc;
+    return str;
+}
+
+int CodecParseFields(const char *str, char sep, int *values, int maxCount, const char **end)
+{
+    int count = 0;
+    const char *next;
+
+    while (count < maxCount && (next = CodecParseInt(str, &values[count])))
+    {
+        str = next;
+        count += 1;
+        if (count == maxCount || *str != sep)
+            break;
+        str += 1;
+    }
+    // A separator which is not followed by a number is not taken
+    if (count > 0 && str[-1] == sep)
+        str -= 1;
+
+    if (end)
+        *end = str;
+    return count;
+}
+
+char *CodecFormatInt(char *str, int value)
+{
+    char buffer[CODEC_INT_MAX];
+    char *p = buffer + sizeof(buffer);
+    unsigned long u = value < 0 ? (unsigned long)-(long)value : (unsigned long)value;
+
+    while (u >= 100)
+    {
+        unsigned r = u % 100;
+        u /= 100;
+        p -= 2;
+        memcpy(p, digitPairs + 2 * r, 2);
+    }
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, digitPairs + 2 * u, 2);
+    }
+    else
+    {
+        *--p = '0' + u;
+    }
+
+    if (value < 0)
+        *str++ = '-';
+    int len = buffer + sizeof(buffer) - p;
+    memcpy(str, p, len);
+    str += len;
+    *str = '\0';
+    return str;
+}
+
+char *CodecFormatFields(char *str, char sep, const int *values, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            *str++ = sep;
+        str = CodecFormatInt(str, values[i]);
+    }
+    *str = '\0';
+    return str;
+}
@@ -0,0 +1,25 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+// Parsing and formatting of the integer fields of the messages and the library
+// files: "M:N:K" tasks, "ID:M:N:K[:SEQ]" results and "M:N:K:ID" lines. Unlike
+// sscanf() and sprintf() the routines know only decimal ints: no locale, no
+// varargs, no format string to interpret and no allocation.
+
+#define CODEC_INT_MAX 11 /* Longest formatted int, "-2147483648" */
+
+// Parses a decimal int with an optional '-', returns the character after it,
+// or NULL if there is no digit or the number does not fit into an int
+const char *CodecParseInt(const char *str, int *value);
+
+// Parses up to maxCount ints separated by sep, as sscanf() with "%d:%d:..." does:
+// returns how many were parsed and sets *end (unless it is NULL) after the last one
+int CodecParseFields(const char *str, char sep, int *values, int maxCount, const char **end);
+
+// Writes the int, returns the end of the text; the text is null-terminated
+char *CodecFormatInt(char *str, int value);
+
+// Writes the ints separated by sep, returns the end of the text
+char *CodecFormatFields(char *str, char sep, const int *values, int count);
+
+#endif
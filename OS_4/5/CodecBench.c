@@ -0,0 +1,194 @@
+#include <stdio.h>      /* for printf(), sprintf() and sscanf() */
+#include <stdlib.h>     /* for atoi(), rand() and exit() */
+#include <string.h>     /* for strcmp() */
+
+#include "Book.h"
+#include "Task.h"
+#include "Codec.h"
+#include "Clock.h"
+
+// Compares the message codec with the sscanf() and sprintf() calls it replaced,
+// on the messages and library lines the server, the relay and the workers handle
+
+#define SAMPLES 1024       /* Distinct values cycled through, so nothing is constant */
+#define DEFAULT_ROUNDS 2000000
+
+typedef struct Sample
+{
+    Book book;
+    int seq;
+    char task[32];   // "M:N:K"
+    char result[64]; // "ID:M:N:K:SEQ"
+    char line[64];   // "M:N:K:ID" of a library file
+} Sample;
+
+static Sample samples[SAMPLES];
+static volatile int sink; // keeps the results alive
+
+// The previous implementations
+
+static void OldTaskFormat(char *str, const Task *task)
+{
+    sprintf(str, "%d:%d:%d", task->m, task->n, task->k);
+}
+
+static int OldTaskParse(const char *str, Task *task)
+{
+    return sscanf(str, "%d:%d:%d", &task->m, &task->n, &task->k) == 3;
+}
+
+static int OldResultParse(const char *str, Book *book, int *seq)
+{
+    return sscanf(str, "%d:%d:%d:%d:%d", &book->id, &book->pos.m, &book->pos.n, &book->pos.k, seq) == 5;
+}
+
+static int OldLineParse(const char *str, Book *book)
+{
+    return sscanf(str, "%d:%d:%d:%d", &book->pos.m, &book->pos.n, &book->pos.k, &book->id) == 4;
+}
+
+static int SameBook(const Book *b1, const Book *b2)
+{
+    return b1->id == b2->id && b1->pos.m == b2->pos.m && b1->pos.n == b2->pos.n && b1->pos.k == b2->pos.k;
+}
+
+// The codec, as the callers use it
+
+static void NewTaskFormat(char *str, const Task *task)
+{
+    int values[3] = {task->m, task->n, task->k};
+    CodecFormatFields(str, ':', values, 3);
+}
+
+static int NewTaskParse(const char *str, Task *task)
+{
+    return TaskParse(str, task);
+}
+
+static int NewResultParse(const char *str, Book *book, int *seq)
+{
+    int values[5];
+    if (CodecParseFields(str, ':', values, 5, NULL) != 5)
+        return 0;
+    book->id = values[0];
+    book->pos.m = values[1];
+    book->pos.n = values[2];
+    book->pos.k = values[3];
+    *seq = values[4];
+    return 1;
+}
+
+static int NewLineParse(const char *str, Book *book)
+{
+    int values[4];
+    if (CodecParseFields(str, ':', values, 4, NULL) != 4)
+        return 0;
+    book->pos.m = values[0];
+    book->pos.n = values[1];
+    book->pos.k = values[2];
+    book->id = values[3];
+    return 1;
+}
+
+static double TimeFormat(void (*format)(char *, const Task *), int rounds)
+{
+    char buffer[64];
+    long start = ClockNowNs();
+    for (int i = 0; i < rounds; ++i)
+    {
+        format(buffer, &samples[i % SAMPLES].book.pos);
+        sink += buffer[0];
+    }
+    return (double)(ClockNowNs() - start) / rounds;
+}
+
+static double TimeTaskParse(int (*parse)(const char *, Task *), int rounds)
+{
+    Task task;
+    long start = ClockNowNs();
+    for (int i = 0; i < rounds; ++i)
+    {
+        sink += parse(samples[i % SAMPLES].task, &task) + task.k;
+    }
+    return (double)(ClockNowNs() - start) / rounds;
+}
+
+static double TimeResultParse(int (*parse)(const char *, Book *, int *), int rounds)
+{
+    Book book;
+    int seq;
+    long start = ClockNowNs();
+    for (int i = 0; i < rounds; ++i)
+    {
+        sink += parse(samples[i % SAMPLES].result, &book, &seq) + seq;
+    }
+    return (double)(ClockNowNs() - start) / rounds;
+}
+
+static double TimeLineParse(int (*parse)(const char *, Book *), int rounds)
+{
+    Book book;
+    long start = ClockNowNs();
+    for (int i = 0; i < rounds; ++i)
+    {
+        sink += parse(samples[i % SAMPLES].line, &book) + book.id;
+    }
+    return (double)(ClockNowNs() - start) / rounds;
+}
+
+static void Report(const char *name, double oldNs, double newNs)
+{
+    printf("%-14s sscanf/sprintf %7.1f ns   codec %6.1f ns   x%.1f\n", name, oldNs, newNs, oldNs / newNs);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+    if (argc > 2 || rounds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [<Rounds>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Positions and IDs as large as the generator makes them
+    srand(1);
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        Sample *s = &samples[i];
+        s->book.pos.m = rand() % 1000;
+        s->book.pos.n = rand() % 1000;
+        s->book.pos.k = rand() % 1000;
+        s->book.id = rand() % 1000000000;
+        s->seq = rand() % 100000;
+        sprintf(s->task, "%d:%d:%d", s->book.pos.m, s->book.pos.n, s->book.pos.k);
+        sprintf(s->result, "%d:%d:%d:%d:%d", s->book.id, s->book.pos.m, s->book.pos.n, s->book.pos.k, s->seq);
+        sprintf(s->line, "%d:%d:%d:%d", s->book.pos.m, s->book.pos.n, s->book.pos.k, s->book.id);
+    }
+
+    // Both must agree on every sample before they are compared
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        Sample *s = &samples[i];
+        char oldText[64], newText[64];
+        Book oldBook, newBook;
+        int oldSeq, newSeq;
+
+        OldTaskFormat(oldText, &s->book.pos);
+        NewTaskFormat(newText, &s->book.pos);
+        if (strcmp(oldText, newText) != 0 ||
+            !NewResultParse(s->result, &newBook, &newSeq) || !OldResultParse(s->result, &oldBook, &oldSeq) ||
+            oldSeq != newSeq || !SameBook(&oldBook, &newBook) ||
+            !NewLineParse(s->line, &newBook) || !SameBook(&newBook, &s->book))
+        {
+            fprintf(stderr, "The codec differs on '%s'\n", s->result);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%d rounds\n", rounds);
+    Report("task format", TimeFormat(OldTaskFormat, rounds), TimeFormat(NewTaskFormat, rounds));
+    Report("task parse", TimeTaskParse(OldTaskParse, rounds), TimeTaskParse(NewTaskParse, rounds));
+    Report("result parse", TimeResultParse(OldResultParse, rounds), TimeResultParse(NewResultParse, rounds));
+    Report("library line", TimeLineParse(OldLineParse, rounds), TimeLineParse(NewLineParse, rounds));
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,369 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <stdlib.h>     /* for atoi() and exit() */
+#include <string.h>     /* for memset() */
+#include <unistd.h>     /* for close() */
+#include <poll.h>       /* for poll() */
+
+#include "Address.h"
+#include "IO.h"
+#include "Book.h"
+#include "Vector.h"
+#include "Codec.h"
+#include "RowRange.h"
+#include "Clock.h"
+
+// Coordinator of a federated recovery. The rows of the library are split evenly
+// among several Server processes, each started with its row range; the coordinator
+// redirects the workers to the partitions holding their rows, follows the progress
+// of the partitions and fetches their catalogs, which it merges once all are complete.
+
+#define MSGMAX 255           /* Longest message string */
+#define MAX_PARTITIONS 32    /* Servers the library can be split among */
+#define MAX_OBSERVERS 16     /* Observers of the merged catalog */
+#define POLL_PERIOD_MS 200   /* How often the partitions are asked for their progress */
+#define SHUTDOWN_DELAY_MS 5000 /* Time the coordinator keeps telling workers to stop */
+
+DEFINE_VECTOR(BookList, Book)
+DEFINE_VECTOR_ORDER(BookList, Book, BookLess)
+
+typedef enum PartitionState
+{
+    PARTITION_RUNNING,  // recovering its books
+    PARTITION_FETCHING, // complete, its catalog is being fetched
+    PARTITION_DONE      // its catalog has been merged
+} PartitionState;
+
+typedef struct Partition
+{
+    Address addr;
+    char name[ADDRLEN]; // address sent to the redirected workers
+    RowRange rows;
+    PartitionState state;
+    int recovered, total; // progress reported by the partition, total is 0 until known
+    int offset;           // books of its catalog fetched so far
+    long askedAt;         // time of the last request to the partition, ns
+    int redirected;       // workers sent to the partition
+} Partition;
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// Sends the message to the observers and prints it
+void Notify(const char *msg);
+// Asks the partition for its progress or for the next part of its catalog
+void AskPartition(Partition *partition);
+// Handles a reply of the partition
+void HandlePartitionReply(Partition *partition, char *msg);
+// Handles a message of a worker or an observer
+void HandleClientMessage(char *msg, const Address *clientAddr);
+// Chooses the partition for a worker holding the rows, NULL if none has tasks left
+Partition *ChoosePartition(const RowRange *rows, int rowRangeCount);
+// Prints the merged catalog
+void PrintCatalog();
+
+int sock;
+Partition partitions[MAX_PARTITIONS];
+int partitionCount;
+int partitionsDone;
+Address observers[MAX_OBSERVERS];
+int observerCount;
+BookList catalog;
+
+int main(int argc, char *argv[])
+{
+    Address localAddr;      /* Local address of the coordinator */
+    Address fromAddr;       /* Source address of a message */
+    char buffer[MSGMAX + 1]; /* Buffer for receiving messages */
+    int msgLen;              /* Length of received message */
+
+    if (argc < 4 || argc - 3 > MAX_PARTITIONS) /* Test for correct number of arguments */
+    {
+        fprintf(stderr, "Usage: %s <SERVER PORT | unix:<PATH>> <M> <Partition Address>...\n", argv[0]);
+        fprintf(stderr, "  Partition Address: IP:PORT | unix:PATH of a Server started with <Rows>,\n");
+        fprintf(stderr, "  the rows are split evenly among the partitions in the given order\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const int M = atoi(argv[2]);
+    partitionCount = argc - 3;
+
+    if (!AddressParseLocal(argv[1], &localAddr) || localAddr.sa.sa_family == AF_SHM)
+    {
+        fprintf(stderr, "Invalid coordinator address '%s'\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    if (partitionCount > M)
+    {
+        fprintf(stderr, "More partitions than rows\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < partitionCount; ++i)
+    {
+        Partition *partition = &partitions[i];
+        memset(partition, 0, sizeof(*partition));
+
+        // Partitions are polled through the socket of the coordinator
+        if (!AddressParse(argv[3 + i], &partition->addr) || partition->addr.sa.sa_family != localAddr.sa.sa_family)
+        {
+            fprintf(stderr, "Invalid partition address '%s'\n", argv[3 + i]);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(partition->name, argv[3 + i]);
+        partition->rows.first = i * M / partitionCount;
+        partition->rows.last = (i + 1) * M / partitionCount - 1;
+        partition->state = PARTITION_RUNNING;
+
+        printf("Partition %s serves rows %d-%d\n", partition->name, partition->rows.first, partition->rows.last);
+    }
+
+    BookListInit(&catalog);
+    sock = CreateServerSocket(&localAddr);
+
+    for (int i = 0; i < partitionCount; ++i)
+    {
+        AskPartition(&partitions[i]);
+    }
+
+    long doneAt = -1;
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+
+    for (;;)
+    {
+        long now = ClockNowNs();
+        if (doneAt >= 0 && now - doneAt > SHUTDOWN_DELAY_MS * NS_PER_MS)
+            break;
+
+        // Retry the partitions which have not answered within the period
+        for (int i = 0; i < partitionCount; ++i)
+        {
+            if (partitions[i].state != PARTITION_DONE && now - partitions[i].askedAt >= POLL_PERIOD_MS * NS_PER_MS)
+                AskPartition(&partitions[i]);
+        }
+
+        if (poll(&pfd, 1, POLL_PERIOD_MS) <= 0)
+            continue;
+
+        msgLen = MSGMAX;
+        RecvFrom(sock, buffer, &msgLen, &fromAddr);
+        buffer[msgLen] = '\0';
+
+        Partition *partition = NULL;
+        for (int i = 0; i < partitionCount && !partition; ++i)
+        {
+            if (AddressEqual(&partitions[i].addr, &fromAddr))
+                partition = &partitions[i];
+        }
+
+        if (partition)
+        {
+            HandlePartitionReply(partition, buffer);
+            if (partitionsDone == partitionCount && doneAt < 0)
+            {
+                doneAt = ClockNowNs();
+                BookListSort(&catalog);
+                PrintCatalog();
+                Notify("NO_MORE_TASKS");
+            }
+        }
+        else
+        {
+            HandleClientMessage(buffer, &fromAddr);
+        }
+    }
+
+    printf("The coordinator is shutting down.\n");
+
+    if (localAddr.sa.sa_family == AF_UNIX)
+        unlink(localAddr.un.sun_path);
+    close(sock);
+    BookListFree(&catalog);
+    exit(EXIT_SUCCESS);
+}
+
+void Notify(const char *msg)
+{
+    for (int i = 0; i < observerCount; ++i)
+    {
+        SendTo(sock, msg, strlen(msg), &observers[i]);
+    }
+    printf("%s\n", msg);
+}
+
+void AskPartition(Partition *partition)
+{
+    char request[32];
+    CodecFormatInt(stpcpy(request, "CATALOG "), partition->offset);
+    SendTo(sock, request, strlen(request), &partition->addr);
+    partition->askedAt = ClockNowNs();
+}
+
+void HandlePartitionReply(Partition *partition, char *msg)
+{
+    RowRange rows;
+    int offset, recovered, total, size;
+    const char *rest;
+
+    if (strncmp(msg, "PENDING ", 8) == 0 && (rest = CodecParseInt(msg + 8, &rows.first)) && *rest == '-' &&
+        (rest = CodecParseInt(rest + 1, &rows.last)) && *rest == ' ' &&
+        (rest = CodecParseInt(rest + 1, &recovered)) && *rest == ' ' && CodecParseInt(rest + 1, &total))
+    {
+        if (rows.first != partition->rows.first || rows.last != partition->rows.last)
+        {
+            fprintf(stderr, "Partition %s serves rows %d-%d instead of %d-%d\n", partition->name,
+                    rows.first, rows.last, partition->rows.first, partition->rows.last);
+            exit(EXIT_FAILURE);
+        }
+        partition->recovered = recovered;
+        partition->total = total;
+    }
+    else if (strncmp(msg, "BOOKS ", 6) == 0 && (rest = CodecParseInt(msg + 6, &offset)))
+    {
+        // A retransmitted request may be answered twice, only the expected part is taken
+        if (partition->state == PARTITION_DONE || offset != partition->offset)
+            return;
+        partition->state = PARTITION_FETCHING;
+        partition->recovered = partition->total;
+
+        int fields[4];
+        for (const char *str = rest; *str == ' ' && CodecParseFields(str + 1, ':', fields, 4, &str) == 4;)
+        {
+            Book book = {fields[0], {fields[1], fields[2], fields[3]}};
+            BookListPushBack(&catalog, book);
+            partition->offset += 1;
+        }
+
+        // Fetch the next part at once
+        AskPartition(partition);
+    }
+    else if (strncmp(msg, "CATALOG_END ", 12) == 0 && CodecParseInt(msg + 12, &size))
+    {
+        if (partition->state == PARTITION_DONE || size != partition->offset)
+            return;
+        partition->state = PARTITION_DONE;
+        partitionsDone += 1;
+        printf("Partition %s recovered %d books\n", partition->name, size);
+    }
+}
+
+void HandleClientMessage(char *msg, const Address *clientAddr)
+{
+    char reply[MSGMAX + 1];
+
+    if (strcmp(msg, "I_AM_OBSERVER") == 0)
+    {
+        for (int i = 0; i < observerCount; ++i)
+        {
+            if (AddressEqual(&observers[i], clientAddr))
+                return;
+        }
+        if (observerCount < MAX_OBSERVERS)
+            observers[observerCount++] = *clientAddr;
+        return;
+    }
+
+    if (strcmp(msg, "DISCONNECT") == 0)
+    {
+        for (int i = 0; i < observerCount; ++i)
+        {
+            if (AddressEqual(&observers[i], clientAddr))
+                observers[i] = observers[--observerCount];
+        }
+        return;
+    }
+
+    if (strcmp(msg, "STATS") == 0)
+    {
+        for (int i = 0; i < partitionCount; ++i)
+        {
+            Partition *partition = &partitions[i];
+            sprintf(reply, "partition=%s rows=%d-%d recovered=%d/%d redirected=%d fetched=%d",
+                    partition->name, partition->rows.first, partition->rows.last,
+                    partition->recovered, partition->total, partition->redirected, partition->offset);
+            SendTo(sock, reply, strlen(reply), clientAddr);
+        }
+        SendTo(sock, "END_STATS", strlen("END_STATS"), clientAddr);
+        return;
+    }
+
+    if (strncmp(msg, "GIVE_ME_TASK", 12) == 0 && (msg[12] == '\0' || msg[12] == ' ' || msg[12] == ':'))
+    {
+        // GIVE_ME_TASK[:SEQ][ ROWS], the reply carries the sequence number back
+        const char *rest = msg + 12;
+        int seq = -1;
+        RowRange rows[MAX_ROW_RANGES];
+        int rowRangeCount = 0;
+
+        if (*rest == ':' && !(rest = CodecParseInt(rest + 1, &seq)))
+            return;
+        if (*rest == ' ' && (rowRangeCount = RowRangesParse(rest + 1, rows, MAX_ROW_RANGES)) < 0)
+            return;
+
+        Partition *partition = ChoosePartition(rows, rowRangeCount);
+        if (partition)
+        {
+            partition->redirected += 1;
+            sprintf(reply, "REDIRECT %s", partition->name);
+        }
+        else
+        {
+            strcpy(reply, "NO_MORE_TASKS");
+        }
+        if (seq >= 0)
+        {
+            char *end = reply + strlen(reply);
+            *end++ = ':';
+            CodecFormatInt(end, seq);
+        }
+        SendTo(sock, reply, strlen(reply), clientAddr);
+    }
+    // Heartbeats and anything else are for the partitions
+}
+
+Partition *ChoosePartition(const RowRange *rows, int rowRangeCount)
+{
+    // The partition with the most tasks left per worker sent to it
+    Partition *best = NULL;
+    double bestScore = 0;
+
+    for (int i = 0; i < partitionCount; ++i)
+    {
+        Partition *partition = &partitions[i];
+        if (partition->state != PARTITION_RUNNING || (partition->total > 0 && partition->recovered == partition->total))
+            continue;
+
+        int holds = rowRangeCount == 0;
+        for (int m = partition->rows.first; m <= partition->rows.last && !holds; ++m)
+        {
+            holds = RowRangesContain(rows, rowRangeCount, m);
+        }
+        if (!holds)
+            continue;
+
+        // Before its first report the partition counts as untouched
+        double left = partition->total > 0 ? partition->total - partition->recovered : 1e9;
+        double score = left / (partition->redirected + 1);
+        if (!best || score > bestScore)
+        {
+            best = partition;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+void PrintCatalog()
+{
+    char buffer[MSGMAX + 1];
+
+    Notify("The recovered catalog is:");
+    for (int i = 0; i < catalog.size; ++i)
+    {
+        Book *book = &catalog.data[i];
+        sprintf(buffer, "%d - %d, %d, %d", book->id, book->pos.m, book->pos.n, book->pos.k);
+        Notify(buffer);
+    }
+}
@@ -0,0 +1,81 @@
+#include "DList.h"
+#include <assert.h>
+
+void DListInit(DList *list)
+{
+    assert(list);
+    list->head.prev = &list->head;
+    list->head.next = &list->head;
+    list->size = 0;
+}
+
+int DListEmpty(const DList *list)
+{
+    return list->size == 0;
+}
+
+int DListSize(const DList *list)
+{
+    return list->size;
+}
+
+DLink *DListFront(DList *list)
+{
+    return DListEmpty(list) ? NULL : list->head.next;
+}
+
+DLink *DListBack(DList *list)
+{
+    return DListEmpty(list) ? NULL : list->head.prev;
+}
+
+// Insert the link between two adjacent links
+static void DListLink(DList *list, DLink *link, DLink *prev, DLink *next)
+{
+    link->prev = prev;
+    link->next = next;
+    prev->next = link;
+    next->prev = link;
+    list->size += 1;
+}
+
+void DListPushFront(DList *list, DLink *link)
+{
+    assert(list && link);
+    DListLink(list, link, &list->head, list->head.next);
+}
+
+void DListPushBack(DList *list, DLink *link)
+{
+    assert(list && link);
+    DListLink(list, link, list->head.prev, &list->head);
+}
+
+DLink *DListPopFront(DList *list)
+{
+    assert(list);
+    assert(!DListEmpty(list));
+    DLink *link = list->head.next;
+    DListRemove(list, link);
+    return link;
+}
+
+DLink *DListPopBack(DList *list)
+{
+    assert(list);
+    assert(!DListEmpty(list));
+    DLink *link = list->head.prev;
+    DListRemove(list, link);
+    return link;
+}
+
+void DListRemove(DList *list, DLink *link)
+{
+    assert(list && link);
+    assert(link->prev && link->next);
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = NULL;
+    link->next = NULL;
+    list->size -= 1;
+}
@@ -0,0 +1,45 @@
+#ifndef DLIST_H
+#define DLIST_H
+
+#include <stddef.h> /* for offsetof() */
+
+// Link fields embedded into the item stored in the intrusive list
+typedef struct DLink
+{
+    struct DLink *prev;
+    struct DLink *next;
+} DLink;
+
+// Intrusive doubly-linked list: items carry their own links, so no
+// allocation happens on insertion and removal by handle is O(1)
+typedef struct DList
+{
+    DLink head; // sentinel, head.next is the first item, head.prev is the last
+    int size;
+} DList;
+
+// Get the item which contains the given link
+#define DLIST_ENTRY(link, type, member) ((type *)((char *)(link) - offsetof(type, member)))
+
+// Iterate over the list; the current link must not be removed inside the loop
+#define DLIST_FOREACH(iter, list) \
+    for (DLink *iter = (list)->head.next; iter != &(list)->head; iter = iter->next)
+
+void DListInit(DList *list);
+
+int DListEmpty(const DList *list);
+int DListSize(const DList *list);
+
+DLink *DListFront(DList *list);
+DLink *DListBack(DList *list);
+
+void DListPushFront(DList *list, DLink *link);
+void DListPushBack(DList *list, DLink *link);
+
+DLink *DListPopFront(DList *list);
+DLink *DListPopBack(DList *list);
+
+// Unlink the item from the list it belongs to
+void DListRemove(DList *list, DLink *link);
+
+#endif
@@ -0,0 +1,38 @@
+#define _DEFAULT_SOURCE
+#include "Distribution.h"
+#include <stdio.h>  /* for sscanf() */
+#include <stdlib.h> /* for drand48() */
+#include <math.h>   /* for log() */
+
+int DistributionParse(const char *spec, Distribution *dist)
+{
+    if (sscanf(spec, "fixed:%lf", &dist->a) == 1)
+    {
+        dist->kind = DIST_FIXED;
+        return dist->a >= 0;
+    }
+    if (sscanf(spec, "uniform:%lf:%lf", &dist->a, &dist->b) == 2)
+    {
+        dist->kind = DIST_UNIFORM;
+        return dist->a >= 0 && dist->b >= dist->a;
+    }
+    if (sscanf(spec, "exp:%lf", &dist->a) == 1)
+    {
+        dist->kind = DIST_EXPONENTIAL;
+        return dist->a >= 0;
+    }
+    return 0;
+}
+
+double DistributionSample(const Distribution *dist)
+{
+    switch (dist->kind)
+    {
+    case DIST_FIXED:
+        return dist->a;
+    case DIST_UNIFORM:
+        return dist->a + (dist->b - dist->a) * drand48();
+    default:
+        return -dist->a * log(1.0 - drand48());
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+// Random distribution of a non-negative quantity (e.g. a service time in ms),
+// written as fixed:T, uniform:MIN:MAX or exp:MEAN
+typedef struct Distribution
+{
+    enum { DIST_FIXED, DIST_UNIFORM, DIST_EXPONENTIAL } kind;
+    double a, b;
+} Distribution;
+
+// Parses the specification, returns 0 if it is invalid
+int DistributionParse(const char *spec, Distribution *dist);
+
+// Draws a value using drand48()
+double DistributionSample(const Distribution *dist);
+
+#endif
@@ -1,5 +1,47 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "BlockFile.h"
+
+// The parallel mode writes fixed-width lines, e.g. "003:017:042:0123456789",
+// so the offset of every book in its file is known before it is generated.
+// Its IDs come from a bijection of the position index instead of rand(),
+// which makes them unique without remembering the ones already used.
+// A file named *.blk is written in the binary block format of BlockFile.h
+// instead, which gives random access to the IDs but does not compress them.
+
+#define ID_MASK 0x7fffffffu /* IDs are below 2^31, as the ones of rand() */
+#define ID_WIDTH 10         /* Digits of the largest ID */
+#define ID_SEED 0x5bd1e995u
+#define CHUNK_BOOKS 65536   /* Books a thread formats before writing them */
+#define MAX_THREADS 256
+#define BLOCK_SUFFIX ".blk"
+
+// Files of the parallel mode and their fixed-width lines
+typedef struct layout
+{
+    long books;       // M * N * K
+    long shard_books; // books per file
+    int widths[3];    // digits of the last M, N and K
+    int line_len;
+    int N, K;
+    int *fds;         // one per file
+    int thread_count;
+    long shard_blocks; // blocks per file of the block format
+    long blocks;
+    long *offsets;     // of every block in its file
+} layout;
+
+typedef struct writer
+{
+    const layout *lay;
+    int thread;
+    int sizing; // the first pass of the block format, which only measures the blocks
+} writer;
 
 // Check if name (ID) is unique
 int is_unique(int name, int *arr, int size)
@@ -28,11 +70,326 @@ void gen_unique_names(int *arr, int size)
     }
 }
 
+// Name of the file holding the row: the only one, or the shard of the row
+void shard_name(char *name, const char *filename, int rowsPerShard, int m)
+{
+    if (rowsPerShard)
+        snprintf(name, FILENAME_MAX, "%s.%d", filename, m / rowsPerShard);
+    else
+        snprintf(name, FILENAME_MAX, "%s", filename);
+}
+
+// Map the position index to its name (ID), each step is invertible modulo 2^31
+unsigned permute_name(unsigned x)
+{
+    x = (x ^ ID_SEED) & ID_MASK;
+    x = (x * 0x2c1b3c6du) & ID_MASK;
+    x ^= x >> 13;
+    x = (x * 0x297a2d39u) & ID_MASK;
+    x ^= x >> 16;
+    return x;
+}
+
+// Number of decimal digits of the value
+int digits(unsigned value)
+{
+    int count = 1;
+    while (value >= 10)
+    {
+        value /= 10;
+        ++count;
+    }
+    return count;
+}
+
+// Write the value with leading zeros, returns the end of the field
+char *format_padded(char *str, unsigned value, int width)
+{
+    for (int i = width - 1; i >= 0; --i)
+    {
+        str[i] = '0' + value % 10;
+        value /= 10;
+    }
+    return str + width;
+}
+
+// Write the whole buffer at the offset, pwrite() may write only part of it
+void write_at(int fd, const void *buffer, long len, long offset)
+{
+    for (long written = 0; written < len;)
+    {
+        ssize_t ret = pwrite(fd, (const char *)buffer + written, len - written, offset + written);
+        if (ret < 0)
+        {
+            perror("pwrite() failed");
+            exit(EXIT_FAILURE);
+        }
+        written += ret;
+    }
+}
+
+// Generate and write every thread_count-th chunk of books, starting with the one of the thread
+void *write_chunks(void *arg)
+{
+    const writer *w = arg;
+    const layout *lay = w->lay;
+    char *buffer = malloc((long)CHUNK_BOOKS * lay->line_len);
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (long start = (long)w->thread * CHUNK_BOOKS; start < lay->books; start += (long)lay->thread_count * CHUNK_BOOKS)
+    {
+        long end = start + CHUNK_BOOKS < lay->books ? start + CHUNK_BOOKS : lay->books;
+
+        // A chunk may span the end of a file, each part goes to its own
+        for (long idx = start; idx < end;)
+        {
+            long shard = idx / lay->shard_books;
+            long partEnd = (shard + 1) * lay->shard_books < end ? (shard + 1) * lay->shard_books : end;
+
+            char *line = buffer;
+            int k = idx % lay->K;
+            int n = idx / lay->K % lay->N;
+            int m = idx / lay->K / lay->N;
+            for (long i = idx; i < partEnd; ++i)
+            {
+                line = format_padded(line, m, lay->widths[0]);
+                *line++ = ':';
+                line = format_padded(line, n, lay->widths[1]);
+                *line++ = ':';
+                line = format_padded(line, k, lay->widths[2]);
+                *line++ = ':';
+                line = format_padded(line, permute_name(i), ID_WIDTH);
+                *line++ = '\n';
+
+                if (++k == lay->K)
+                {
+                    k = 0;
+                    if (++n == lay->N)
+                    {
+                        n = 0;
+                        ++m;
+                    }
+                }
+            }
+
+            // Offsets are fixed, so the parts may be written in any order
+            long len = line - buffer;
+            long offset = (idx - shard * lay->shard_books) * lay->line_len;
+            write_at(lay->fds[shard], buffer, len, offset);
+            idx = partEnd;
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+// Books in the file before its block, and how many the block holds
+int block_books(const layout *lay, long block, long *first)
+{
+    long shard = block / lay->shard_blocks;
+    long shardBooks = lay->books - shard * lay->shard_books < lay->shard_books ? lay->books - shard * lay->shard_books : lay->shard_books;
+    long inShard = (block - shard * lay->shard_blocks) * BLOCK_BOOKS;
+    *first = shard * lay->shard_books + inShard;
+    return shardBooks - inShard < BLOCK_BOOKS ? shardBooks - inShard : BLOCK_BOOKS;
+}
+
+// Measure or write every thread_count-th group of blocks, starting with the one of the thread
+void *write_blocks(void *arg)
+{
+    const writer *w = arg;
+    const layout *lay = w->lay;
+    const long groupBlocks = CHUNK_BOOKS / BLOCK_BOOKS;
+    unsigned char *buffer = malloc(groupBlocks * BLOCK_MAX_LEN);
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (long start = w->thread * groupBlocks; start < lay->blocks; start += lay->thread_count * groupBlocks)
+    {
+        long end = start + groupBlocks < lay->blocks ? start + groupBlocks : lay->blocks;
+        unsigned char *out = buffer;
+        long partStart = start;
+
+        for (long b = start; b < end; ++b)
+        {
+            int names[BLOCK_BOOKS];
+            long first;
+            int count = block_books(lay, b, &first);
+            for (int i = 0; i < count; ++i)
+                names[i] = permute_name(first + i);
+
+            if (w->sizing)
+            {
+                lay->offsets[b] = BlockEncodedLen(names, count);
+                continue;
+            }
+            out += BlockEncode(out, names, count);
+
+            // The blocks of one file are contiguous, write them at once
+            long shard = b / lay->shard_blocks;
+            if (b + 1 == end || (b + 1) / lay->shard_blocks != shard)
+            {
+                write_at(lay->fds[shard], buffer, out - buffer, lay->offsets[partStart]);
+                out = buffer;
+                partStart = b + 1;
+            }
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+// Run the function on the threads
+void run_writers(layout *lay, void *(*work)(void *), int sizing)
+{
+    pthread_t threads[MAX_THREADS];
+    writer writers[MAX_THREADS];
+    for (int t = 0; t < lay->thread_count; ++t)
+    {
+        writers[t].lay = lay;
+        writers[t].thread = t;
+        writers[t].sizing = sizing;
+        if (pthread_create(&threads[t], NULL, work, &writers[t]) != 0)
+        {
+            fprintf(stderr, "Unable to start a thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int t = 0; t < lay->thread_count; ++t)
+    {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+// Write the block files: the blocks are measured first, which places them,
+// then written, and finally the headers and the tables of their offsets
+void gen_blocks(layout *lay, int M, int N, int K, int rowsPerShard, int shards)
+{
+    lay->shard_blocks = (lay->shard_books + BLOCK_BOOKS - 1) / BLOCK_BOOKS;
+    long lastBooks = lay->books - (shards - 1) * lay->shard_books;
+    lay->blocks = (shards - 1) * lay->shard_blocks + (lastBooks + BLOCK_BOOKS - 1) / BLOCK_BOOKS;
+    lay->offsets = malloc(lay->blocks * sizeof(*lay->offsets));
+    if (lay->offsets == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run_writers(lay, write_blocks, 1);
+
+    long total = 0;
+    for (int s = 0; s < shards; ++s)
+    {
+        long *table = lay->offsets + s * lay->shard_blocks;
+        long count = s < shards - 1 ? lay->shard_blocks : lay->blocks - s * lay->shard_blocks;
+
+        // Sizes become offsets
+        long offset = BlockFileDataStart(count);
+        for (long b = 0; b < count; ++b)
+        {
+            long size = table[b];
+            table[b] = offset;
+            offset += size;
+        }
+        total += offset;
+
+        BlockFileHeader header;
+        memset(&header, 0, sizeof(header));
+        strcpy(header.magic, BLOCK_FILE_MAGIC);
+        header.firstRow = rowsPerShard ? s * rowsPerShard : 0;
+        header.lastRow = rowsPerShard && (s + 1) * rowsPerShard < M ? (s + 1) * rowsPerShard - 1 : M - 1;
+        header.N = N;
+        header.K = K;
+        header.blockCount = count;
+        write_at(lay->fds[s], &header, sizeof(header), 0);
+        write_at(lay->fds[s], table, count * sizeof(*table), sizeof(header));
+        write_at(lay->fds[s], &offset, sizeof(offset), sizeof(header) + count * sizeof(*table));
+    }
+
+    run_writers(lay, write_blocks, 0);
+    free(lay->offsets);
+
+    printf("Wrote %ld books to %d file(s) in %ld blocks, %.2f bytes per book\n",
+           lay->books, shards, lay->blocks, (double)total / lay->books);
+}
+
+// Write the library on several threads, without printing it
+int gen_parallel(int M, int N, int K, const char *filename, int rowsPerShard, int threadCount)
+{
+    layout lay;
+    if (M <= 0 || N <= 0 || K <= 0)
+    {
+        fprintf(stderr, "M, N and K must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+    lay.books = (long)M * N * K;
+    if (lay.books > (long)ID_MASK + 1)
+    {
+        fprintf(stderr, "At most 2^31 books have unique names\n");
+        exit(EXIT_FAILURE);
+    }
+    lay.widths[0] = digits(M - 1);
+    lay.widths[1] = digits(N - 1);
+    lay.widths[2] = digits(K - 1);
+    lay.line_len = lay.widths[0] + lay.widths[1] + lay.widths[2] + ID_WIDTH + 4;
+    lay.N = N;
+    lay.K = K;
+    lay.thread_count = threadCount;
+
+    size_t nameLen = strlen(filename);
+    int blockFile = nameLen > strlen(BLOCK_SUFFIX) && strcmp(filename + nameLen - strlen(BLOCK_SUFFIX), BLOCK_SUFFIX) == 0;
+
+    // Create every file, the text ones at their final size
+    int shards = rowsPerShard ? (M + rowsPerShard - 1) / rowsPerShard : 1;
+    lay.shard_books = (long)(rowsPerShard ? rowsPerShard : M) * N * K;
+    lay.fds = malloc(shards * sizeof(*lay.fds));
+    for (int s = 0; s < shards; ++s)
+    {
+        char shardname[FILENAME_MAX];
+        shard_name(shardname, filename, rowsPerShard, s * rowsPerShard);
+        lay.fds[s] = open(shardname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        long shardBooks = s < shards - 1 ? lay.shard_books : lay.books - s * lay.shard_books;
+        if (lay.fds[s] < 0 || (!blockFile && ftruncate(lay.fds[s], shardBooks * lay.line_len) < 0))
+        {
+            fprintf(stderr, "Unable to create file '%s'\n", shardname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (blockFile)
+        gen_blocks(&lay, M, N, K, rowsPerShard, shards);
+    else
+        run_writers(&lay, write_chunks, 0);
+
+    for (int s = 0; s < shards; ++s)
+    {
+        close(lay.fds[s]);
+    }
+    free(lay.fds);
+
+    if (!blockFile)
+        printf("Wrote %ld books to %d file(s) of %d-byte lines\n", lay.books, shards, lay.line_len);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 5)
+    if (argc < 5 || argc > 7)
     {
-        fprintf(stderr, "Usage: %s <M> <N> <K> <filename>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <M> <N> <K> <filename> [<Rows per shard> | all [<Threads>]]\n", argv[0]);
+        fprintf(stderr, "  With rows per shard, the library is split into the files <filename>.0, <filename>.1, ...\n");
+        fprintf(stderr, "  each holding that many rows\n");
+        fprintf(stderr, "  With threads, the books are written in parallel as fixed-width lines and not printed,\n");
+        fprintf(stderr, "  or as binary blocks with random access, about 4 bytes per book and not compressed,\n");
+        fprintf(stderr, "  if the filename ends with " BLOCK_SUFFIX "\n");
         exit(EXIT_FAILURE);
     }
 
@@ -40,13 +397,25 @@ int main(int argc, char *argv[])
     const int N = atoi(argv[2]);    
     const int K = atoi(argv[3]);
     const char *filename = argv[4];
-
-    FILE *fp = fopen(filename, "w");
-    if (fp == NULL)
+    const int sharded = argc >= 6 && strcmp(argv[5], "all") != 0;
+    const int rowsPerShard = sharded ? atoi(argv[5]) : 0;
+    if (sharded && rowsPerShard <= 0)
     {
-        fprintf(stderr, "Unable to create file '%s'\n", filename);
+        fprintf(stderr, "Rows per shard must be positive\n");
         exit(EXIT_FAILURE);
     }
+    if (argc == 7)
+    {
+        const int threadCount = atoi(argv[6]);
+        if (threadCount <= 0 || threadCount > MAX_THREADS)
+        {
+            fprintf(stderr, "Threads must be 1 - %d\n", MAX_THREADS);
+            exit(EXIT_FAILURE);
+        }
+        return gen_parallel(M, N, K, filename, rowsPerShard, threadCount);
+    }
+
+    FILE *fp = NULL;
 
     // Create array for book's names
     int *arr = malloc(M* N * K * sizeof(*arr));
@@ -56,6 +425,22 @@ int main(int argc, char *argv[])
     // Output generated names and positions
     for (int m = 0; m < M; ++m)    
     {
+        // Start the next file: the only one, or the shard of this row
+        if (m == 0 || (rowsPerShard && m % rowsPerShard == 0))
+        {
+            char shardname[FILENAME_MAX];
+            shard_name(shardname, filename, rowsPerShard, m);
+
+            if (fp)
+                fclose(fp);
+            fp = fopen(shardname, "w");
+            if (fp == NULL)
+            {
+                fprintf(stderr, "Unable to create file '%s'\n", shardname);
+                exit(EXIT_FAILURE);
+            }
+        }
+
         for (int n = 0; n < N; ++n)
         {
             for (int k = 0; k < K; ++k)
@@ -68,7 +453,8 @@ int main(int argc, char *argv[])
     }
 
     free(arr);
-    fclose(fp);
+    if (fp)
+        fclose(fp);
 
     return EXIT_SUCCESS;
 }
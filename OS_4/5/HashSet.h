@@ -0,0 +1,133 @@
+#ifndef HASHSET_H
+#define HASHSET_H
+
+#include <stdlib.h>
+#include <assert.h>
+
+// Mix the bits of an integer key (finalizer of MurmurHash3)
+static inline unsigned int HashInt(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+// Typed hash set with the elements stored inline in a dense array and an
+// open-addressing (linear probing) table of indices into that array.
+// Iteration walks items[0 .. size) without touching the table.
+// Hash(const Type *) -> unsigned int and Equal(const Type *, const Type *) -> int
+// are expanded inline, so they may be macros or inline functions.
+// Pointers to the elements are invalidated by Name##Insert and Name##Remove.
+#define DEFINE_HASHSET(Name, Type, Hash, Equal)                                \
+    typedef struct Name                                                        \
+    {                                                                          \
+        Type *items;  /* dense array of the elements */                        \
+        int size;                                                              \
+        int *slots;   /* index into items, -1 for an empty slot */             \
+        int slotMask; /* number of slots - 1, the number is a power of two */  \
+    } Name;                                                                    \
+                                                                               \
+    static inline void Name##Init(Name *set)                                   \
+    {                                                                          \
+        set->items = NULL;                                                     \
+        set->size = 0;                                                         \
+        set->slots = NULL;                                                     \
+        set->slotMask = -1;                                                    \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Free(Name *set)                                   \
+    {                                                                          \
+        free(set->items);                                                      \
+        free(set->slots);                                                      \
+        Name##Init(set);                                                       \
+    }                                                                          \
+                                                                               \
+    /* Slot holding the key, or the empty slot where it would be placed */     \
+    static inline int Name##Probe(const Name *set, const Type *key)            \
+    {                                                                          \
+        int slot = Hash(key) & set->slotMask;                                  \
+        while (set->slots[slot] >= 0 && !Equal(&set->items[set->slots[slot]], key)) \
+            slot = (slot + 1) & set->slotMask;                                 \
+        return slot;                                                           \
+    }                                                                          \
+                                                                               \
+    /* Keep the load factor at or below 1/2; items has as many entries as slots / 2 */ \
+    static inline void Name##Grow(Name *set)                                   \
+    {                                                                          \
+        int slotCount = set->slotMask < 0 ? 16 : 2 * (set->slotMask + 1);      \
+        free(set->slots);                                                      \
+        set->slots = malloc(slotCount * sizeof(int));                          \
+        set->items = realloc(set->items, slotCount / 2 * sizeof(Type));        \
+        assert(set->slots && set->items);                                      \
+        set->slotMask = slotCount - 1;                                         \
+        for (int i = 0; i < slotCount; ++i)                                    \
+            set->slots[i] = -1;                                                \
+        for (int i = 0; i < set->size; ++i)                                    \
+            set->slots[Name##Probe(set, &set->items[i])] = i;                  \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##Find(const Name *set, const Type *key)           \
+    {                                                                          \
+        if (set->size == 0)                                                    \
+            return NULL;                                                       \
+        int idx = set->slots[Name##Probe(set, key)];                           \
+        return idx >= 0 ? &set->items[idx] : NULL;                             \
+    }                                                                          \
+                                                                               \
+    /* Insert the item if no equal one is stored; returns the stored element */ \
+    /* and sets *inserted (if not NULL) to tell which case happened */          \
+    static inline Type *Name##Insert(Name *set, Type item, int *inserted)      \
+    {                                                                          \
+        if (2 * (set->size + 1) > set->slotMask + 1)                           \
+            Name##Grow(set);                                                   \
+        int slot = Name##Probe(set, &item);                                    \
+        if (inserted)                                                          \
+            *inserted = set->slots[slot] < 0;                                  \
+        if (set->slots[slot] < 0)                                              \
+        {                                                                      \
+            set->items[set->size] = item;                                      \
+            set->slots[slot] = set->size++;                                    \
+        }                                                                      \
+        return &set->items[set->slots[slot]];                                  \
+    }                                                                          \
+                                                                               \
+    /* Remove the element equal to the key; returns 0 if there is none */      \
+    static inline int Name##Remove(Name *set, const Type *key)                 \
+    {                                                                          \
+        if (set->size == 0)                                                    \
+            return 0;                                                          \
+        int slot = Name##Probe(set, key);                                      \
+        int idx = set->slots[slot];                                            \
+        if (idx < 0)                                                           \
+            return 0;                                                          \
+                                                                               \
+        /* Backward-shift deletion keeps probe chains without tombstones */    \
+        int hole = slot;                                                       \
+        int next = (hole + 1) & set->slotMask;                                 \
+        while (set->slots[next] >= 0)                                          \
+        {                                                                      \
+            int home = Hash(&set->items[set->slots[next]]) & set->slotMask;    \
+            /* move the entry if its home is not in (hole, next] */            \
+            if (((next - home) & set->slotMask) >= ((next - hole) & set->slotMask)) \
+            {                                                                  \
+                set->slots[hole] = set->slots[next];                           \
+                hole = next;                                                   \
+            }                                                                  \
+            next = (next + 1) & set->slotMask;                                 \
+        }                                                                      \
+        set->slots[hole] = -1;                                                 \
+                                                                               \
+        /* Fill the gap in the dense array with the last element */            \
+        int last = --set->size;                                                \
+        if (idx != last)                                                       \
+        {                                                                      \
+            set->slots[Name##Probe(set, &set->items[last])] = idx;             \
+            set->items[idx] = set->items[last];                                \
+        }                                                                      \
+        return 1;                                                              \
+    }
+
+#endif
@@ -0,0 +1,69 @@
+#include "Histogram.h"
+#include <stdio.h>
+#include <string.h>
+
+static int BucketIndex(unsigned long value)
+{
+    if (value < HIST_SUB_COUNT)
+        return value;
+    int exponent = 63 - __builtin_clzl(value); // >= HIST_SUB_BITS
+    int sub = (value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1);
+    return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+}
+
+// Middle of the range of values counted in the bucket
+static long BucketValue(int idx)
+{
+    if (idx < HIST_SUB_COUNT)
+        return idx;
+    int exponent = idx / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    int sub = idx % HIST_SUB_COUNT;
+    int shift = exponent - HIST_SUB_BITS;
+    unsigned long lower = (unsigned long)(HIST_SUB_COUNT + sub) << shift;
+    return lower + ((1UL << shift) >> 1);
+}
+
+void HistogramInit(Histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void HistogramRecord(Histogram *h, long value)
+{
+    if (value < 0)
+        value = 0;
+    h->buckets[BucketIndex(value)] += 1;
+    h->count += 1;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+long HistogramPercentile(const Histogram *h, double percentile)
+{
+    if (h->count == 0)
+        return 0;
+    long rank = (long)(percentile / 100.0 * h->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i)
+    {
+        seen += h->buckets[i];
+        if (seen >= rank)
+        {
+            long value = BucketValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+int HistogramFormat(const Histogram *h, const char *name, long scale, char *buffer, int bufferLen)
+{
+    return snprintf(buffer, bufferLen, "%s n=%ld mean=%ld p50=%ld p90=%ld p99=%ld p999=%ld max=%ld",
+                    name, h->count, h->count ? h->sum / h->count / scale : 0,
+                    HistogramPercentile(h, 50) / scale, HistogramPercentile(h, 90) / scale,
+                    HistogramPercentile(h, 99) / scale, HistogramPercentile(h, 99.9) / scale,
+                    h->max / scale);
+}
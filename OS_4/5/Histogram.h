@@ -0,0 +1,32 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Log-linear histogram in the spirit of HdrHistogram: values below 2^HIST_SUB_BITS
+// are counted exactly, larger ones fall into 2^HIST_SUB_BITS buckets per power of two,
+// so the relative error is below 1 / 2^HIST_SUB_BITS for any non-negative value.
+// Recording is a few integer operations and never allocates.
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct Histogram
+{
+    long count;
+    long max;
+    long sum;
+    long buckets[HIST_BUCKETS];
+} Histogram;
+
+void HistogramInit(Histogram *h);
+
+void HistogramRecord(Histogram *h, long value);
+
+// Value at the given percentile (0 - 100), approximated by its bucket
+long HistogramPercentile(const Histogram *h, double percentile);
+
+// Compact one line summary: "<name> n=.. mean=.. p50=.. p90=.. p99=.. p999=.. max=..",
+// the values are divided by scale (e.g. 1000 to print nanoseconds as microseconds)
+int HistogramFormat(const Histogram *h, const char *name, long scale, char *buffer, int bufferLen);
+
+#endif
@@ -11,28 +11,16 @@
 #include <sys/file.h>   /* for O_NONBLOCK and FASYNC */
 #include <signal.h>     /* for signal() and SIGALRM */
 #include <errno.h>      /* for errno */
+#include <time.h>       /* for clock_gettime() */
+
+#define SEND_RETRIES 50   /* Attempts to send to a Unix-domain peer with a full queue */
+#define SEND_RETRY_US 200 /* Pause between the attempts */
 
 void DieWithError(char *errorMessage); /* External error handling function */
 
-int CreateUDPServerWithSIGIO(unsigned short serverPort, void (*SIGIOHandler)(int))
+void SetSIGIOHandler(void (*SIGIOHandler)(int))
 {
-    struct sockaddr_in serverAddr; /* Server address */
-    int sock;
-    struct sigaction handler;      /* Signal handling action definition */
-
-    /* Create socket for sending/receiving datagrams */
-    if ((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
-        DieWithError("socket() failed");
-
-    /* Set up the server address structure */
-    memset(&serverAddr, 0, sizeof(serverAddr));     /* Zero out structure */
-    serverAddr.sin_family = AF_INET;                /* Internet family */
-    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY); /* Any incoming interface */
-    serverAddr.sin_port = htons(serverPort);       /* Port */
-
-    /* Bind to the local address */
-    if (bind(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
-        DieWithError("bind() failed");
+    struct sigaction handler; /* Signal handling action definition */
 
     /* Set signal handler for SIGIO */
     handler.sa_handler = SIGIOHandler;
@@ -44,6 +32,62 @@ int CreateUDPServerWithSIGIO(unsigned short serverPort, void (*SIGIOHandler)(int
 
     if (sigaction(SIGIO, &handler, 0) < 0)
         DieWithError("sigaction() failed for SIGIO");
+}
+
+int CreateServerSocket(const Address *localAddr)
+{
+    int sock;
+
+    /* Create socket for sending/receiving datagrams */
+    if ((sock = socket(localAddr->sa.sa_family, SOCK_DGRAM, 0)) < 0)
+        DieWithError("socket() failed");
+
+    /* The socket file of a previous server would make bind() fail */
+    if (localAddr->sa.sa_family == AF_UNIX)
+        unlink(localAddr->un.sun_path);
+
+    /* Bind to the local address */
+    if (bind(sock, &localAddr->sa, localAddr->len) < 0)
+        DieWithError("bind() failed");
+
+    return sock;
+}
+
+void SetSocketBuffers(int sock, int rcvBufSize, int sndBufSize)
+{
+    /* The FORCE options pass the system limits, but only with CAP_NET_ADMIN */
+    if (rcvBufSize > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvBufSize, sizeof(rcvBufSize)) < 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize)) < 0)
+        DieWithError("setsockopt() failed for SO_RCVBUF");
+    if (sndBufSize > 0 && setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &sndBufSize, sizeof(sndBufSize)) < 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndBufSize, sizeof(sndBufSize)) < 0)
+        DieWithError("setsockopt() failed for SO_SNDBUF");
+}
+
+void GetSocketBuffers(int sock, int *rcvBufSize, int *sndBufSize)
+{
+    socklen_t len = sizeof(*rcvBufSize);
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, rcvBufSize, &len) < 0)
+        *rcvBufSize = -1;
+    len = sizeof(*sndBufSize);
+    if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, sndBufSize, &len) < 0)
+        *sndBufSize = -1;
+}
+
+int CreateServerWithSIGIO(const Address *localAddr, int rcvBufSize, int sndBufSize, void (*SIGIOHandler)(int))
+{
+    int sock = CreateServerSocket(localAddr);
+
+    SetSocketBuffers(sock, rcvBufSize, sndBufSize);
+
+    /* Ask for the drop counter and the receive time with each datagram */
+    int on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0)
+        DieWithError("setsockopt() failed for SO_RXQ_OVFL");
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+        DieWithError("setsockopt() failed for SO_TIMESTAMPNS");
+
+    SetSIGIOHandler(SIGIOHandler);
 
     /* We must own the socket to receive the SIGIO message */
     if (fcntl(sock, F_SETOWN, getpid()) < 0)
@@ -56,24 +100,158 @@ int CreateUDPServerWithSIGIO(unsigned short serverPort, void (*SIGIOHandler)(int
     return sock;
 }
 
-void SendTo(int sock, const char *msg, int msgLen, const struct sockaddr_in *addr)
+int CreateClientSocket(const Address *serverAddr)
 {
-    if (sendto(sock, msg, msgLen, 0, (struct sockaddr *)addr, sizeof(*addr)) != msgLen)
+    int sock;
+
+    if (serverAddr->sa.sa_family == AF_SHM)
+    {
+        fprintf(stderr, "Shared memory serves only workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Create a datagram socket of the family of the server */
+    if ((sock = socket(serverAddr->sa.sa_family, SOCK_DGRAM, 0)) < 0)
+        DieWithError("socket() failed");
+
+    /* Binding only the family makes the kernel pick a unique abstract name */
+    if (serverAddr->sa.sa_family == AF_UNIX)
+    {
+        sa_family_t family = AF_UNIX;
+        if (bind(sock, (struct sockaddr *)&family, sizeof(family)) < 0)
+            DieWithError("bind() failed");
+    }
+
+    return sock;
+}
+
+void SendTo(int sock, const char *msg, int msgLen, const Address *addr)
+{
+    int sent = sendto(sock, msg, msgLen, 0, &addr->sa, addr->len);
+
+    /* Unix-domain queues hold only a few datagrams (net.unix.max_dgram_qlen), a burst
+       such as the statistics would overflow them: give the peer a moment to read */
+    for (int i = 0; i < SEND_RETRIES && sent < 0 && errno == EAGAIN && addr->sa.sa_family == AF_UNIX; ++i)
+    {
+        usleep(SEND_RETRY_US);
+        sent = sendto(sock, msg, msgLen, 0, &addr->sa, addr->len);
+    }
+
+    /* A Unix-domain peer which is gone or does not keep up loses the datagram, as with UDP */
+    if (sent < 0 && (errno == EAGAIN || errno == ECONNREFUSED || errno == ENOENT))
+        return;
+    if (sent != msgLen)
         DieWithError("sendto() sent a different number of bytes than expected");
 }
 
-void RecvFrom(int sock, char *msg, int *msgLen, struct sockaddr_in *addr)
+void OutQueueInit(OutQueue *queue, int sock, int capacity)
 {
-    unsigned int addrLen = sizeof(*addr);
-    *msgLen = recvfrom(sock, msg, *msgLen, 0, (struct sockaddr *)addr, &addrLen);
+    memset(queue, 0, sizeof(*queue));
+    queue->sock = sock;
+    queue->capacity = capacity;
+    queue->items = malloc(capacity * sizeof(*queue->items));
+    if (!queue->items)
+        DieWithError("malloc() failed for the outbound queue");
+}
+
+void OutQueueFree(OutQueue *queue)
+{
+    free(queue->items);
+    queue->items = NULL;
+    queue->size = 0;
+}
+
+// Tries to send the datagram: 1 if it is done with (sent or lost), 0 if it must wait
+static int TrySend(OutQueue *queue, const char *msg, int msgLen, const Address *addr)
+{
+    int sent = sendto(queue->sock, msg, msgLen, MSG_DONTWAIT, &addr->sa, addr->len);
+    if (sent == msgLen)
+    {
+        queue->sent += 1;
+        return 1;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))
+        return 0;
+
+    /* A peer which is gone, an unreachable port reported by ICMP, a short write... */
+    queue->failed += 1;
+    return 1;
+}
+
+void OutQueueSend(OutQueue *queue, const char *msg, int msgLen, const Address *addr)
+{
+    // A longer datagram would be cut in the queue, the peer gets none rather than a part
+    if (msgLen > OUT_MSG_MAX)
+    {
+        queue->failed += 1;
+        return;
+    }
+
+    // Datagrams do not overtake the queued ones
+    if (queue->size == 0 && TrySend(queue, msg, msgLen, addr))
+        return;
+
+    if (queue->size == queue->capacity)
+    {
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->size -= 1;
+        queue->dropped += 1;
+    }
+
+    OutDatagram *item = &queue->items[(queue->head + queue->size) % queue->capacity];
+    item->addr = *addr;
+    item->len = msgLen;
+    memcpy(item->msg, msg, msgLen);
+    queue->size += 1;
+    queue->deferred += 1;
+    if (queue->size > queue->maxSize)
+        queue->maxSize = queue->size;
+}
+
+int OutQueueFlush(OutQueue *queue)
+{
+    // A full Unix-domain peer must not hold back the datagrams of the others,
+    // so each one is tried and those which still have to wait are kept in order
+    int kept = 0;
+    for (int i = 0; i < queue->size; ++i)
+    {
+        OutDatagram *item = &queue->items[(queue->head + i) % queue->capacity];
+        if (!TrySend(queue, item->msg, item->len, &item->addr))
+        {
+            if (item->addr.sa.sa_family != AF_UNIX)
+            {
+                // The socket buffer itself is full, nothing else fits either
+                for (; i < queue->size; ++i, ++kept)
+                    queue->items[(queue->head + kept) % queue->capacity] = queue->items[(queue->head + i) % queue->capacity];
+                break;
+            }
+            queue->items[(queue->head + kept) % queue->capacity] = *item;
+            kept += 1;
+        }
+    }
+    queue->size = kept;
+    return kept;
+}
+
+void OutQueueFormat(const OutQueue *queue, const char *name, char *str)
+{
+    sprintf(str, "%s_sent=%ld %s_deferred=%ld %s_dropped=%ld %s_failed=%ld %s_queued=%d %s_max_queued=%d",
+            name, queue->sent, name, queue->deferred, name, queue->dropped, name, queue->failed,
+            name, queue->size, name, queue->maxSize);
+}
+
+void RecvFrom(int sock, char *msg, int *msgLen, Address *addr)
+{
+    addr->len = sizeof(addr->un);
+    *msgLen = recvfrom(sock, msg, *msgLen, 0, &addr->sa, &addr->len);
     if (*msgLen < 0)
         DieWithError("recvfrom() failed");
 }
 
-int RecvFromUnblocked(int sock, char *msg, int *msgLen, struct sockaddr_in *addr)
+int RecvFromUnblocked(int sock, char *msg, int *msgLen, Address *addr)
 {
-    unsigned int addrLen = sizeof(*addr);
-    *msgLen = recvfrom(sock, msg, *msgLen, 0, (struct sockaddr *)addr, &addrLen);
+    addr->len = sizeof(addr->un);
+    *msgLen = recvfrom(sock, msg, *msgLen, 0, &addr->sa, &addr->len);
     if (*msgLen < 0)
     {
         /* Only acceptable error: recvfrom() would have blocked */
@@ -83,3 +261,54 @@ int RecvFromUnblocked(int sock, char *msg, int *msgLen, struct sockaddr_in *addr
     }
     return 1;
 }
+
+int RecvFromUnblockedInfo(int sock, char *msg, int *msgLen, Address *addr, RecvInfo *info)
+{
+    struct iovec iov = {msg, *msgLen};
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(unsigned))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &addr->sa;
+    hdr.msg_namelen = sizeof(addr->un);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buffer;
+    hdr.msg_controllen = sizeof(control.buffer);
+
+    *msgLen = recvmsg(sock, &hdr, 0);
+    if (*msgLen < 0)
+    {
+        /* Only acceptable error: recvmsg() would have blocked */
+        if (errno != EWOULDBLOCK)
+            DieWithError("recvmsg() failed");
+        return 0;
+    }
+    addr->len = hdr.msg_namelen;
+
+    info->queuedNs = -1;
+    info->hasDrops = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            /* The kernel stamps the datagram with the real-time clock */
+            struct timespec stamp, now;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            clock_gettime(CLOCK_REALTIME, &now);
+            info->queuedNs = (now.tv_sec - stamp.tv_sec) * 1000000000L + (now.tv_nsec - stamp.tv_nsec);
+        }
+        else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            memcpy(&info->drops, CMSG_DATA(cmsg), sizeof(info->drops));
+            info->hasDrops = 1;
+        }
+    }
+    return 1;
+}
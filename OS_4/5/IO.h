@@ -1,14 +1,85 @@
 #ifndef IO_H
 #define IO_H
 
-#include <arpa/inet.h>  /* for sockaddr_in */
+#include "Address.h"
 
-int CreateUDPServerWithSIGIO(unsigned short serverPort, void (*SIGIOHandler)(int));
+// Delivers SIGIO to the handler, with all signals blocked while it runs
+void SetSIGIOHandler(void (*SIGIOHandler)(int));
 
-void SendTo(int sock, const char *msg, int msgLen, const struct sockaddr_in *addr);
+// Binds a datagram socket to the local address. A stale Unix-domain socket file
+// left by an earlier server is removed first.
+int CreateServerSocket(const Address *localAddr);
 
-void RecvFrom(int sock, char *msg, int *msgLen, struct sockaddr_in *addr);
+// Binds a datagram socket as CreateServerSocket() does and delivers SIGIO for it.
+// The buffer sizes are set unless they are 0, and the kernel reports drops and
+// receive times with each datagram, see RecvFromUnblockedInfo().
+int CreateServerWithSIGIO(const Address *localAddr, int rcvBufSize, int sndBufSize, void (*SIGIOHandler)(int));
 
-int RecvFromUnblocked(int sock, char *msg, int *msgLen, struct sockaddr_in *addr);
+// Sets the socket buffer sizes, 0 keeps the default. Above the system limits
+// (net.core.rmem_max, wmem_max) the limits apply unless the process may override them.
+void SetSocketBuffers(int sock, int rcvBufSize, int sndBufSize);
+
+// Sizes the kernel actually gives to the socket buffers, twice the requested ones
+void GetSocketBuffers(int sock, int *rcvBufSize, int *sndBufSize);
+
+// Creates a datagram socket for talking to the server. Unix-domain sockets are
+// autobound, so that the server has an address to reply to.
+int CreateClientSocket(const Address *serverAddr);
+
+void SendTo(int sock, const char *msg, int msgLen, const Address *addr);
+
+#define OUT_MSG_MAX 256 /* Longest datagram an outbound queue holds */
+
+typedef struct OutDatagram
+{
+    Address addr;
+    int len;
+    char msg[OUT_MSG_MAX];
+} OutDatagram;
+
+// Datagrams of a nonblocking server socket waiting for room in the socket buffer
+// (or in the queue of a Unix-domain peer). The queue is bounded: when it is full
+// the oldest datagram is dropped, the peers retransmit what they miss. Send errors
+// are counted instead of stopping the server.
+typedef struct OutQueue
+{
+    int sock;
+    OutDatagram *items; // ring buffer
+    int head, size, capacity;
+    int maxSize;        // largest size reached
+    long sent;          // datagrams sent, at once or from the queue
+    long deferred;      // datagrams which had to wait in the queue
+    long dropped;       // datagrams dropped because the queue was full
+    long failed;        // datagrams lost to other errors, e.g. a peer which is gone or one too long
+} OutQueue;
+
+void OutQueueInit(OutQueue *queue, int sock, int capacity);
+
+void OutQueueFree(OutQueue *queue);
+
+// Sends the datagram, or queues it behind the earlier ones if they are still waiting
+// or the socket has no room. A datagram longer than OUT_MSG_MAX is counted as failed.
+void OutQueueSend(OutQueue *queue, const char *msg, int msgLen, const Address *addr);
+
+// Sends the queued datagrams which fit now, returns the number still queued
+int OutQueueFlush(OutQueue *queue);
+
+// Writes the counters as "NAME_sent=... NAME_deferred=..." to str
+void OutQueueFormat(const OutQueue *queue, const char *name, char *str);
+
+void RecvFrom(int sock, char *msg, int *msgLen, Address *addr);
+
+int RecvFromUnblocked(int sock, char *msg, int *msgLen, Address *addr);
+
+// What the kernel tells about a received datagram
+typedef struct RecvInfo
+{
+    long queuedNs;  // time the datagram waited in the receive queue, -1 if unknown
+    int hasDrops;   // drops is known: the kernel reports it once it is not 0
+    unsigned drops; // datagrams the kernel has dropped on the socket so far, the queue being full
+} RecvInfo;
+
+// As RecvFromUnblocked(), with the information enabled by CreateServerWithSIGIO()
+int RecvFromUnblockedInfo(int sock, char *msg, int *msgLen, Address *addr, RecvInfo *info);
 
 #endif
@@ -0,0 +1,1086 @@
+#define _DEFAULT_SOURCE
+#include "Library.h"
+#include <stdio.h>  /* for sprintf() */
+#include <stdarg.h> /* for va_list */
+#include <stdlib.h> /* for malloc() and calloc() */
+#include <string.h> /* for memset() */
+
+#define TASK_TEXT_MAX 36 /* Longest " M:N:K" of a task batch */
+
+const char *messageTypeNames[MSG_TYPE_COUNT] = {
+    "give_me_task", "result", "i_am_observer", "disconnect", "heartbeat", "stats", "catalog", "tasks", "results", "where", "what", "invalid", "dropped"};
+
+void Initialize(Library *library, int M, int N, int K)
+{
+    InitializePartition(library, 0, M - 1, N, K);
+}
+
+void InitializePartition(Library *library, int firstRow, int lastRow, int N, int K)
+{
+    const int M = lastRow - firstRow + 1;
+
+    CatalogInit(&library->catalog);
+    DListInit(&library->pendingTaskQueue);
+    ObserverSetInit(&library->observers);
+    SessionSetInit(&library->sessions);
+    ClosedSessionSetInit(&library->closedSessions);
+    BucketSetInit(&library->buckets);
+    library->sharedBucket.tokens = RATE_BURST;
+    library->sharedBucket.refilledAt = ClockNowNs();
+    library->windowStart = ClockNowNs();
+    library->windowMessages = 0;
+    library->overloaded = 0;
+    library->invalidLoggedAt = 0;
+    library->invalidUnlogged = 0;
+    memset(&library->stats, 0, sizeof(library->stats));
+    library->catalogFullSize = M * N * K;
+    library->firstRow = firstRow;
+    library->M = M;
+    library->N = N;
+    library->K = K;
+    library->shelfCount = M * N;
+    library->shelves = malloc(library->shelfCount * sizeof(*library->shelves));
+    library->shelfWorkers = calloc(library->shelfCount, sizeof(*library->shelfWorkers));
+    library->rowCursor = calloc(M, sizeof(*library->rowCursor));
+    library->nextRow = 0;
+    library->queued = 0;
+    library->pendingByPos = calloc(library->catalogFullSize, sizeof(*library->pendingByPos));
+    library->recovered = calloc(library->catalogFullSize, sizeof(*library->recovered));
+    library->positionIds = malloc(library->catalogFullSize * sizeof(*library->positionIds));
+    BookIdSetInit(&library->booksById);
+    CatalogReserve(&library->catalog, library->catalogFullSize);
+    library->lastSessionScan = ClockNowNs();
+    library->ready = 0;
+    library->fetched = 0;
+    library->send = NULL;
+    library->sendTransportStats = NULL;
+
+    // Fill the task queues
+    for (int shelf = 0; shelf < library->shelfCount; ++shelf)
+    {
+        TaskQueueInit(&library->shelves[shelf]);
+    }
+    for (int m = 0; m < M; ++m)
+    {
+        for (int n = 0; n < N; ++n)
+        {
+            for (int k = 0; k < K; ++k)
+            {
+                Task task = {firstRow + m, n, k};
+                QueueTask(library, &task);
+            }
+        }
+    }
+}
+
+int PositionIndex(Library *library, const Position *pos)
+{
+    int m = pos->m - library->firstRow;
+    if (m < 0 || m >= library->M || pos->n < 0 || pos->n >= library->N || pos->k < 0 || pos->k >= library->K)
+        return -1;
+    return (m * library->N + pos->n) * library->K + pos->k;
+}
+
+Session *FindSession(Library *library, const Address *addr, int create)
+{
+    Session key;
+    key.addr = *addr;
+    SessionRef keyRef = &key;
+
+    SessionRef *ref = SessionSetFind(&library->sessions, &keyRef);
+    if (ref)
+        return *ref;
+    if (!create)
+        return NULL;
+
+    Session *session = malloc(sizeof(*session));
+    session->addr = *addr;
+    session->lastSeen = ClockNowNs();
+    DListInit(&session->leases);
+    session->shelf = -1;
+    session->stealing = 0;
+    session->rowRangeCount = 0;
+    session->rowsKnown = 0;
+    session->lastRequest = 0;
+    session->lastReply[0] = '\0';
+
+    // The worker was only silent for a while: its numbering goes on
+    ClosedSession closedKey;
+    closedKey.addr = *addr;
+    ClosedSession *closed = ClosedSessionSetFind(&library->closedSessions, &closedKey);
+    if (closed)
+    {
+        session->lastRequest = closed->lastRequest;
+        strcpy(session->lastReply, closed->lastReply);
+        ClosedSessionSetRemove(&library->closedSessions, &closedKey);
+    }
+
+    SessionSetInsert(&library->sessions, session, NULL);
+    return session;
+}
+
+void CloseSession(Library *library, Session *session)
+{
+    while (!DListEmpty(&session->leases))
+    {
+        PendingTask *pt = DLIST_ENTRY(DListFront(&session->leases), PendingTask, sessionLink);
+        ReleaseTask(library, pt, 1);
+    }
+
+    if (session->shelf >= 0)
+    {
+        library->shelfWorkers[session->shelf] -= 1;
+    }
+
+    SessionRef ref = session;
+    SessionSetRemove(&library->sessions, &ref);
+    free(session);
+}
+
+void ReleaseTask(Library *library, PendingTask *pt, int requeue)
+{
+    if (requeue)
+    {
+        QueueTask(library, &pt->task);
+        library->stats.requeued += 1;
+    }
+
+    DListRemove(&library->pendingTaskQueue, &pt->link);
+    DListRemove(&pt->session->leases, &pt->sessionLink);
+    library->pendingByPos[PositionIndex(library, &pt->task)] = NULL;
+    free(pt);
+}
+
+void QueueTask(Library *library, const Task *task)
+{
+    TaskQueuePushBack(&library->shelves[(task->m - library->firstRow) * library->N + task->n], *task);
+    library->queued += 1;
+}
+
+// Drops the requeued tasks whose books have been recovered meanwhile from the
+// front of the bookshelf queue and returns the number of tasks left in it
+static int ShelfSize(Library *library, int shelf)
+{
+    TaskQueue *queue = &library->shelves[shelf];
+    while (!TaskQueueEmpty(queue) && library->recovered[PositionIndex(library, TaskQueueFront(queue))])
+    {
+        TaskQueuePopFront(queue);
+        library->queued -= 1;
+    }
+    return TaskQueueSize(queue);
+}
+
+// Takes a task from the front of the bookshelf queue, or from its back if fromBack
+// is set, skipping recovered tasks. Returns 0 if the bookshelf has no task left.
+static int TakeFromShelf(Library *library, int shelf, int fromBack, Task *task)
+{
+    TaskQueue *queue = &library->shelves[shelf];
+    while (ShelfSize(library, shelf) > 0)
+    {
+        *task = fromBack ? TaskQueuePopBack(queue) : TaskQueuePopFront(queue);
+        library->queued -= 1;
+        if (!library->recovered[PositionIndex(library, task)])
+            return 1;
+    }
+    return 0;
+}
+
+// Returns the first bookshelf of row m (counted from firstRow) which has tasks and no worker, -1 if none
+static int FreeShelfInRow(Library *library, int m)
+{
+    // Bookshelves are handed out in order, the cursor never moves back
+    for (; library->rowCursor[m] < library->N; ++library->rowCursor[m])
+    {
+        int shelf = m * library->N + library->rowCursor[m];
+        if (library->shelfWorkers[shelf] == 0 && ShelfSize(library, shelf) > 0)
+            return shelf;
+    }
+    return -1;
+}
+
+// Chooses a new bookshelf for a worker among the rows it holds: the first one
+// nobody works on, otherwise the one with the most tasks left. Returns -1 if no
+// task of these rows is queued.
+static int ChooseShelf(Library *library, Session *session)
+{
+    if (library->queued == 0)
+        return -1;
+
+    if (session->rowRangeCount == 0)
+    {
+        for (; library->nextRow < library->M; ++library->nextRow)
+        {
+            int shelf = FreeShelfInRow(library, library->nextRow);
+            if (shelf >= 0)
+                return shelf;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < session->rowRangeCount; ++i)
+        {
+            int first = session->rows[i].first - library->firstRow;
+            for (int m = first > 0 ? first : 0; m <= session->rows[i].last - library->firstRow && m < library->M; ++m)
+            {
+                int shelf = FreeShelfInRow(library, m);
+                if (shelf >= 0)
+                    return shelf;
+            }
+        }
+    }
+
+    // Every bookshelf with tasks has a worker, or lost it after the cursor had passed:
+    // prefer a bookshelf without a worker, then the one with the most tasks
+    int best = -1, bestFree = 0, bestSize = 0;
+    for (int shelf = 0; shelf < library->shelfCount; ++shelf)
+    {
+        if (!RowRangesContain(session->rows, session->rowRangeCount, library->firstRow + shelf / library->N))
+            continue;
+
+        int size = ShelfSize(library, shelf);
+        int isFree = library->shelfWorkers[shelf] == 0;
+        if (size > 0 && (isFree > bestFree || (isFree == bestFree && size > bestSize)))
+        {
+            best = shelf;
+            bestFree = isFree;
+            bestSize = size;
+        }
+    }
+    return best;
+}
+
+int DispatchTask(Library *library, Session *session, Task *task)
+{
+    // Keep serving the worker from its bookshelf while it has tasks
+    if (session->shelf >= 0 &&
+        RowRangesContain(session->rows, session->rowRangeCount, library->firstRow + session->shelf / library->N) &&
+        TakeFromShelf(library, session->shelf, session->stealing, task))
+        return 1;
+
+    int shelf = ChooseShelf(library, session);
+    if (shelf < 0)
+        return 0;
+
+    if (session->shelf >= 0)
+    {
+        library->shelfWorkers[session->shelf] -= 1;
+    }
+    // A worker which shares the bookshelf works from its back, away from the owner
+    session->stealing = library->shelfWorkers[shelf] > 0;
+    session->shelf = shelf;
+    library->shelfWorkers[shelf] += 1;
+
+    library->stats.shelfChanges += 1;
+    if (session->stealing)
+    {
+        library->stats.steals += 1;
+    }
+
+    return TakeFromShelf(library, shelf, session->stealing, task);
+}
+
+// Adds the tokens earned since the last refill
+static void RefillBucket(Bucket *bucket, long now)
+{
+    bucket->tokens += (double)(now - bucket->refilledAt) * RATE_LIMIT / NS_PER_SEC;
+    if (bucket->tokens > RATE_BURST)
+        bucket->tokens = RATE_BURST;
+    bucket->refilledAt = now;
+}
+
+static Bucket *FindBucket(Library *library, const Address *addr)
+{
+    Bucket key;
+    key.addr = *addr;
+    Bucket *bucket = BucketSetFind(&library->buckets, &key);
+    if (bucket)
+        return bucket;
+    if (library->buckets.size >= MAX_BUCKETS)
+        return &library->sharedBucket;
+
+    key.tokens = RATE_BURST;
+    key.refilledAt = ClockNowNs();
+    return BucketSetInsert(&library->buckets, key, NULL);
+}
+
+int AdmitMessage(Library *library, const Address *addr)
+{
+    long now = ClockNowNs();
+
+    // The overload starts as soon as a window gets too many messages and ends with a calm one
+    if (now - library->windowStart >= OVERLOAD_WINDOW)
+    {
+        if (library->overloaded && library->windowMessages <= OVERLOAD_MESSAGES)
+        {
+            library->overloaded = 0;
+            LogPrintf(LOG_WARN, "The load is back to normal, %ld observer messages were shed", library->stats.shed);
+        }
+        library->windowStart = now;
+        library->windowMessages = 0;
+    }
+    library->windowMessages += 1;
+    if (library->windowMessages > OVERLOAD_MESSAGES && !library->overloaded)
+    {
+        library->overloaded = 1;
+        library->stats.overloads += 1;
+        LogWrite(LOG_WARN, "Overloaded: observer traffic is shed");
+    }
+
+    Bucket *bucket = FindBucket(library, addr);
+    RefillBucket(bucket, now);
+    if (bucket->tokens < 1)
+    {
+        library->stats.rateLimited += 1;
+        return 0;
+    }
+    bucket->tokens -= 1;
+    return 1;
+}
+
+// Counts the invalid message against its address and warns about it, at most once a period
+static MessageType InvalidMessage(Library *library, const char *msg, const Address *clientAddr)
+{
+    library->stats.invalid += 1;
+    library->invalidUnlogged += 1;
+
+    Bucket *bucket = FindBucket(library, clientAddr);
+    bucket->tokens -= INVALID_COST - 1;
+
+    long now = ClockNowNs();
+    if (now - library->invalidLoggedAt >= INVALID_LOG_PERIOD && LOG_ENABLED(LOG_WARN))
+    {
+        char addrBuffer[ADDRLEN];
+        AddressFormat(clientAddr, addrBuffer);
+        LogPrintf(LOG_WARN, "Warning! %ld invalid messages, the last one from %s: \"%.40s\"",
+                  library->invalidUnlogged, addrBuffer, msg);
+        library->invalidLoggedAt = now;
+        library->invalidUnlogged = 0;
+    }
+    return MSG_INVALID;
+}
+
+// Checks if anybody follows the activity of the workers
+static int ActivityFollowed(Library *library)
+{
+    return (library->observers.size > 0 || LOG_ENABLED(LOG_INFO)) && !library->overloaded;
+}
+
+// Notifies the observers about a worker, the first traffic shed under overload
+static void NotifyActivity(Library *library, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void NotifyActivity(Library *library, const char *format, ...)
+{
+    if (!ActivityFollowed(library))
+    {
+        library->stats.shed += library->overloaded ? library->observers.size : 0;
+        return;
+    }
+
+    char notifyBuffer[MSGMAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(notifyBuffer, sizeof(notifyBuffer), format, args);
+    va_end(args);
+    NotifyObservers(library, notifyBuffer);
+}
+
+void NotifyObservers(Library *library, const char *msg)
+{
+    int msgLen = strlen(msg);
+    for (int i = 0; i < library->observers.size; ++i)
+    {
+        library->send(msg, msgLen, &library->observers.items[i].addr);
+    }
+    LogWrite(LOG_INFO, msg);
+}
+
+int ParseMessage(char *msg, Book *book, int *seq)
+{
+    int values[5];
+    int fields = CodecParseFields(msg, ':', values, 5, NULL);
+    if (fields < 4 || (fields == 5 && values[4] <= 0))
+    {
+        // Invalid message, sequence numbers start at 1 as with GIVE_ME_TASK
+        return 0;
+    }
+    book->id = values[0];
+    book->pos.m = values[1];
+    book->pos.n = values[2];
+    book->pos.k = values[3];
+    *seq = fields == 5 ? values[4] : -1;
+    return 1;
+}
+
+void SendStats(Library *library, const Address *clientAddr)
+{
+    char buffer[MSGMAX];
+    Stats *stats = &library->stats;
+
+    for (int type = 0; type < MSG_TYPE_COUNT; ++type)
+    {
+        char name[32];
+        sprintf(name, "service_us.%s", messageTypeNames[type]);
+        HistogramFormat(&stats->service[type], name, 1000, buffer, sizeof(buffer));
+        library->send(buffer, strlen(buffer), clientAddr);
+    }
+
+    HistogramFormat(&stats->lease, "lease_ms", 1000000, buffer, sizeof(buffer));
+    library->send(buffer, strlen(buffer), clientAddr);
+
+    HistogramFormat(&stats->requeue, "requeue_per_pass", 1, buffer, sizeof(buffer));
+    library->send(buffer, strlen(buffer), clientAddr);
+
+    sprintf(buffer, "requeued=%ld shelf_changes=%ld steals=%ld duplicate_results=%ld duplicate_requests=%ld pending=%d queued=%d recovered=%d/%d log_dropped=%ld",
+            stats->requeued, stats->shelfChanges, stats->steals, stats->duplicateResults, stats->duplicateRequests,
+            DListSize(&library->pendingTaskQueue),
+            library->queued, library->catalog.size, library->catalogFullSize, LogDropped());
+    library->send(buffer, strlen(buffer), clientAddr);
+
+    sprintf(buffer, "rate_limited=%ld invalid=%ld shed=%ld overloads=%ld overloaded=%d buckets=%d lookups=%ld",
+            stats->rateLimited, stats->invalid, stats->shed, stats->overloads, library->overloaded, library->buckets.size,
+            stats->lookups);
+    library->send(buffer, strlen(buffer), clientAddr);
+
+    if (library->sendTransportStats)
+        library->sendTransportStats(clientAddr);
+
+    library->send("END_STATS", strlen("END_STATS"), clientAddr);
+}
+
+void SendCatalog(Library *library, int offset, const Address *clientAddr)
+{
+    char buffer[MSGMAX];
+    Catalog *catalog = &library->catalog;
+
+    if (!library->ready)
+    {
+        // "PENDING FIRST-LAST RECOVERED TOTAL"
+        char *end = CodecFormatInt(stpcpy(buffer, "PENDING "), library->firstRow);
+        *end++ = '-';
+        end = CodecFormatInt(end, library->firstRow + library->M - 1);
+        *end++ = ' ';
+        end = CodecFormatInt(end, catalog->size);
+        *end++ = ' ';
+        CodecFormatInt(end, library->catalogFullSize);
+    }
+    else if (offset >= catalog->size)
+    {
+        CodecFormatInt(stpcpy(buffer, "CATALOG_END "), catalog->size);
+        library->fetched = 1;
+    }
+    else
+    {
+        // As many books as fit into the datagram
+        int len = CodecFormatInt(stpcpy(buffer, "BOOKS "), offset) - buffer;
+        for (; offset < catalog->size; ++offset)
+        {
+            char bookBuffer[64];
+            Book *book = &catalog->data[offset];
+            int fields[4] = {book->id, book->pos.m, book->pos.n, book->pos.k};
+            bookBuffer[0] = ' ';
+            int bookLen = CodecFormatFields(bookBuffer + 1, ':', fields, 4) - bookBuffer;
+            if (len + bookLen >= MSGMAX)
+                break;
+            memcpy(buffer + len, bookBuffer, bookLen + 1);
+            len += bookLen;
+        }
+    }
+    library->send(buffer, strlen(buffer), clientAddr);
+}
+
+void PrintCatalog(Library *library)
+{
+    char notifyBuffer[MSGMAX];
+
+    NotifyObservers(library, "The recovered catalog is:");
+    for (int i = 0; i < library->catalog.size; ++i)
+    {
+        Book *book = &library->catalog.data[i];
+        sprintf(notifyBuffer, "%d - %d, %d, %d", book->id, book->pos.m, book->pos.n, book->pos.k);
+        NotifyObservers(library, notifyBuffer);
+    }
+}
+
+// Answers a request the worker has sent before with the reply remembered for it,
+// so that a retransmitted request never takes a second lease. Returns 0 for a new request.
+static int RepeatReply(Library *library, int seq, const Address *clientAddr)
+{
+    if (seq < 0)
+        return 0;
+
+    int lastRequest;
+    const char *lastReply;
+    Session *session = FindSession(library, clientAddr, 0);
+    if (session)
+    {
+        lastRequest = session->lastRequest;
+        lastReply = session->lastReply;
+    }
+    else
+    {
+        // The session may have been closed while the request was on its way
+        ClosedSession key;
+        key.addr = *clientAddr;
+        ClosedSession *closed = ClosedSessionSetFind(&library->closedSessions, &key);
+        if (!closed)
+            return 0;
+        lastRequest = closed->lastRequest;
+        lastReply = closed->lastReply;
+    }
+    if (seq > lastRequest)
+        return 0;
+
+    if (session)
+        session->lastSeen = ClockNowNs();
+    // No reply is remembered for a worker which has not numbered its requests
+    if (seq == lastRequest && lastReply[0] != '\0')
+    {
+        library->send(lastReply, strlen(lastReply), clientAddr);
+        library->stats.duplicateRequests += 1;
+    }
+    // An older request has been answered, and the worker has moved on since
+    return 1;
+}
+
+// Leases the task dispatched to the worker
+static void LeaseTask(Library *library, Session *session, const Task *task, const char *addrBuffer)
+{
+    NotifyActivity(library, "Sending next task (%d, %d, %d) to client %s", task->m, task->n, task->k, addrBuffer);
+
+    PendingTask *pt = malloc(sizeof(*pt));
+    pt->task = *task;
+    pt->dispatchedAt = ClockNowNs();
+    pt->session = session;
+    DListPushBack(&library->pendingTaskQueue, &pt->link);
+    DListPushBack(&session->leases, &pt->sessionLink);
+    library->pendingByPos[PositionIndex(library, &pt->task)] = pt;
+}
+
+// Stores the book found at the position with the given index
+static void RecordResult(Library *library, const Book *b, int idx, const char *addrBuffer)
+{
+    // Remove pending task from the queue
+    PendingTask *pt = library->pendingByPos[idx];
+    if (pt)
+    {
+        HistogramRecord(&library->stats.lease, ClockNowNs() - pt->dispatchedAt);
+        ReleaseTask(library, pt, 0);
+    }
+
+    NotifyActivity(library, "Client %s found book %d at position (%d, %d, %d)", addrBuffer, b->id, b->pos.m, b->pos.n, b->pos.k);
+
+    // Append the book to the catalog unless its position is already recovered
+    if (!library->recovered[idx])
+    {
+        library->recovered[idx] = 1;
+        library->positionIds[idx] = b->id;
+        CatalogPushBack(&library->catalog, *b);
+    }
+    else
+    {
+        library->stats.duplicateResults += 1;
+    }
+
+    // Check if catalog is completely recovered
+    if (library->catalog.size == library->catalogFullSize && !library->ready)
+    {
+        library->ready = 1;
+        CatalogSort(&library->catalog);
+        for (int i = 0; i < library->catalog.size; ++i)
+        {
+            BookIdSetInsert(&library->booksById, library->catalog.data[i], NULL);
+        }
+        PrintCatalog(library);
+        NotifyObservers(library, "NO_MORE_TASKS");
+    }
+}
+
+// Answers "WHERE ID[ ID...]" (where is set) or "WHAT M:N:K[ M:N:K...]"
+static MessageType HandleQuery(Library *library, char *msg, const Address *clientAddr, int where)
+{
+    const char *str = msg + (where ? 5 : 4);
+    char reply[MSGMAX + 1];
+    int fieldCount = where ? 1 : 3;
+    int fields[4];
+
+    // Check the whole query before answering any of it
+    if (*str == '\0')
+        return InvalidMessage(library, msg, clientAddr);
+    while (*str != '\0')
+    {
+        if (*str != ' ' || CodecParseFields(str + 1, ':', fields, fieldCount, &str) != fieldCount ||
+            (*str != ' ' && *str != '\0'))
+            return InvalidMessage(library, msg, clientAddr);
+    }
+
+    if (!library->ready)
+    {
+        library->send("PENDING", strlen("PENDING"), clientAddr);
+        return where ? MSG_WHERE : MSG_WHAT;
+    }
+
+    strcpy(reply, where ? "WHERE" : "WHAT");
+    int len = strlen(reply);
+    for (str = msg + len; *str != '\0';)
+    {
+        // Each item is an ID and a position, or a dash for the unknown half
+        char item[4 * CODEC_INT_MAX + 4];
+        char *end = item;
+        Book key;
+        const Book *book = NULL;
+
+        CodecParseFields(str + 1, ':', fields, fieldCount, &str);
+        if (where)
+        {
+            key.id = fields[0];
+            book = BookIdSetFind(&library->booksById, &key);
+            end = CodecFormatInt(end, fields[0]);
+            if (book)
+            {
+                int pos[3] = {book->pos.m, book->pos.n, book->pos.k};
+                *end++ = ':';
+                end = CodecFormatFields(end, ':', pos, 3);
+            }
+            else
+            {
+                end = stpcpy(end, ":-");
+            }
+        }
+        else
+        {
+            Position pos = {fields[0], fields[1], fields[2]};
+            int idx = PositionIndex(library, &pos);
+            if (idx >= 0)
+            {
+                fields[3] = library->positionIds[idx];
+                end = CodecFormatInt(end, fields[3]);
+            }
+            else
+            {
+                *end++ = '-';
+            }
+            *end++ = ':';
+            end = CodecFormatFields(end, ':', fields, 3);
+        }
+
+        if (len + 1 + (end - item) > MSGMAX)
+            break;
+        reply[len++] = ' ';
+        memcpy(reply + len, item, end - item + 1);
+        len += end - item;
+        library->stats.lookups += 1;
+    }
+
+    library->send(reply, len, clientAddr);
+    return where ? MSG_WHERE : MSG_WHAT;
+}
+
+// Parses " ID:M:N:K" of a result batch, returns the end of it or NULL if it is invalid
+static const char *ParseBatchResult(const char *str, Book *b)
+{
+    int values[4];
+    if (*str != ' ' || CodecParseFields(str + 1, ':', values, 4, &str) != 4)
+        return NULL;
+    b->id = values[0];
+    b->pos.m = values[1];
+    b->pos.n = values[2];
+    b->pos.k = values[3];
+    return str;
+}
+
+// Answers "TASKS:SEQ COUNT[ ROWS]" of a relay with as many of the tasks as fit into a datagram
+static MessageType HandleTaskBatch(Library *library, char *msg, const Address *clientAddr, const char *addrBuffer)
+{
+    char *args = msg + 6;
+    char reply[MSGMAX];
+    RowRange rows[MAX_ROW_RANGES];
+    int rowRangeCount = 0; // a relay without rows takes tasks from the whole library
+    int seq, count;
+
+    const char *rest = CodecParseInt(args, &seq);
+    if (rest && *rest == ' ')
+        rest = CodecParseInt(rest + 1, &count);
+    else
+        rest = NULL;
+    int valid = rest && seq > 0 && count > 0;
+    if (valid && *rest == ' ')
+    {
+        rowRangeCount = RowRangesParse(rest + 1, rows, MAX_ROW_RANGES);
+        valid = rowRangeCount >= 0;
+    }
+    else if (valid && *rest != '\0')
+    {
+        valid = 0;
+    }
+    if (!valid)
+    {
+        return InvalidMessage(library, msg, clientAddr);
+    }
+
+    if (RepeatReply(library, seq, clientAddr))
+    {
+        return MSG_TASKS;
+    }
+
+    NotifyActivity(library, "Client %s requests %d tasks", addrBuffer, count);
+
+    Session *session = FindSession(library, clientAddr, 1);
+    session->lastSeen = ClockNowNs();
+    memcpy(session->rows, rows, rowRangeCount * sizeof(*rows));
+    session->rowRangeCount = rowRangeCount;
+    session->rowsKnown = 1;
+
+    int replyLen = CodecFormatInt(stpcpy(reply, "TASKS:"), seq) - reply;
+    int dispatched = 0;
+    Task task;
+    while (dispatched < count && replyLen + TASK_TEXT_MAX < MSGMAX && DispatchTask(library, session, &task))
+    {
+        LeaseTask(library, session, &task, addrBuffer);
+        int fields[3] = {task.m, task.n, task.k};
+        reply[replyLen] = ' ';
+        replyLen = CodecFormatFields(reply + replyLen + 1, ':', fields, 3) - reply;
+        dispatched += 1;
+    }
+    if (dispatched == 0)
+    {
+        CodecFormatInt(stpcpy(reply, library->ready ? "NO_MORE_TASKS:" : "PENDING:"), seq);
+    }
+
+    session->lastRequest = seq;
+    strcpy(session->lastReply, reply);
+    library->send(reply, strlen(reply), clientAddr);
+    return MSG_TASKS;
+}
+
+// Stores the results forwarded by a relay, "RESULTS:SEQ ID:M:N:K...", and acknowledges them
+static MessageType HandleResultBatch(Library *library, char *msg, const Address *clientAddr, const char *addrBuffer)
+{
+    char *args = msg + 8;
+    char reply[32];
+    Book b;
+    int seq;
+
+    // Check the whole batch before storing any of it
+    const char *books = CodecParseInt(args, &seq);
+    const char *str = books;
+    int valid = str && seq > 0;
+    while (valid && *str != '\0')
+    {
+        str = ParseBatchResult(str, &b);
+        valid = str && PositionIndex(library, &b.pos) >= 0;
+    }
+    if (!valid)
+    {
+        return InvalidMessage(library, msg, clientAddr);
+    }
+
+    if (RepeatReply(library, seq, clientAddr))
+    {
+        return MSG_RESULTS;
+    }
+
+    for (str = books; *str != '\0';)
+    {
+        str = ParseBatchResult(str, &b);
+        RecordResult(library, &b, PositionIndex(library, &b.pos), addrBuffer);
+    }
+
+    Session *session = FindSession(library, clientAddr, 1);
+    session->lastSeen = ClockNowNs();
+    CodecFormatInt(stpcpy(reply, "ACK "), seq);
+    session->lastRequest = seq;
+    strcpy(session->lastReply, reply);
+    library->send(reply, strlen(reply), clientAddr);
+    return MSG_RESULTS;
+}
+
+MessageType HandleMessage(Library *library, char *msgBuffer, const Address *clientAddr)
+{
+    char addrBuffer[ADDRLEN];
+    MessageType type;
+    RowRange rows[MAX_ROW_RANGES];
+    int rowRangeCount = -1; // rows advertised with the task request, -1 if none
+    int seq = -1;           // sequence number of the request, -1 if none
+
+    if (!AdmitMessage(library, clientAddr))
+        return MSG_DROPPED;
+
+    // The address is formatted only for those who read it
+    addrBuffer[0] = '\0';
+    if (ActivityFollowed(library) || LOG_ENABLED(LOG_DEBUG))
+        AddressFormat(clientAddr, addrBuffer);
+    if (LOG_ENABLED(LOG_DEBUG))
+        LogPrintf(LOG_DEBUG, "Handling client %s...", addrBuffer);
+
+    if (strcmp(msgBuffer, "I_AM_OBSERVER") == 0)
+    {
+        // This is the first message from the observer client, new ones wait for the overload to pass
+        if (library->overloaded)
+        {
+            library->stats.shed += 1;
+            return MSG_DROPPED;
+        }
+
+        Observer obs;
+        obs.addr = *clientAddr;
+
+        int inserted;
+        ObserverSetInsert(&library->observers, obs, &inserted);
+        if (inserted)
+        {
+            NotifyActivity(library, "Client %s is registered as observer", addrBuffer);
+        }
+
+        return MSG_I_AM_OBSERVER;
+    }
+
+    if (strcmp(msgBuffer, "DISCONNECT") == 0)
+    {
+        NotifyActivity(library, "Client %s will be disconnected", addrBuffer);
+
+        // Check if an observer wants to disconnect and remove it from the set
+        Observer obs;
+        obs.addr = *clientAddr;
+        if (!ObserverSetRemove(&library->observers, &obs))
+        {
+            // A worker wants to disconnect: requeue its tasks right away
+            Session *session = FindSession(library, clientAddr, 0);
+            if (session)
+            {
+                CloseSession(library, session);
+            }
+        }
+
+        return MSG_DISCONNECT;
+    }
+
+    if (strcmp(msgBuffer, "HEARTBEAT") == 0)
+    {
+        // A busy worker is still alive
+        Session *session = FindSession(library, clientAddr, 0);
+        if (session)
+        {
+            session->lastSeen = ClockNowNs();
+        }
+        return MSG_HEARTBEAT;
+    }
+
+    if (strcmp(msgBuffer, "STATS") == 0)
+    {
+        SendStats(library, clientAddr);
+        return MSG_STATS;
+    }
+
+    if (strncmp(msgBuffer, "CATALOG ", 8) == 0)
+    {
+        int offset;
+        const char *rest = CodecParseInt(msgBuffer + 8, &offset);
+        if (!rest || *rest != '\0' || offset < 0)
+            return InvalidMessage(library, msgBuffer, clientAddr);
+        SendCatalog(library, offset, clientAddr);
+        return MSG_CATALOG;
+    }
+
+    if (strncmp(msgBuffer, "TASKS:", 6) == 0)
+    {
+        return HandleTaskBatch(library, msgBuffer, clientAddr, addrBuffer);
+    }
+
+    if (strncmp(msgBuffer, "RESULTS:", 8) == 0)
+    {
+        return HandleResultBatch(library, msgBuffer, clientAddr, addrBuffer);
+    }
+
+    if (strncmp(msgBuffer, "WHERE", 5) == 0)
+    {
+        return HandleQuery(library, msgBuffer, clientAddr, 1);
+    }
+
+    if (strncmp(msgBuffer, "WHAT", 4) == 0)
+    {
+        return HandleQuery(library, msgBuffer, clientAddr, 0);
+    }
+
+    if (strncmp(msgBuffer, "GIVE_ME_TASK", 12) == 0 &&
+        (msgBuffer[12] == '\0' || msgBuffer[12] == ' ' || msgBuffer[12] == ':'))
+    {
+        // This is the first message from the worker client: GIVE_ME_TASK[:SEQ][ ROWS],
+        // a worker holding only a part of the library lists its rows
+        const char *rest = msgBuffer + 12;
+        int valid = 1;
+        if (*rest == ':')
+        {
+            const char *end = CodecParseInt(rest + 1, &seq);
+            valid = end && seq > 0;
+            rest = end ? end : rest + 1;
+        }
+        if (*rest == ' ')
+        {
+            rowRangeCount = RowRangesParse(rest + 1, rows, MAX_ROW_RANGES);
+            valid = valid && rowRangeCount >= 0;
+        }
+        else if (*rest != '\0')
+        {
+            valid = 0;
+        }
+        if (!valid)
+        {
+            return InvalidMessage(library, msgBuffer, clientAddr);
+        }
+
+        if (RepeatReply(library, seq, clientAddr))
+        {
+            return MSG_GIVE_ME_TASK;
+        }
+
+        NotifyActivity(library, "Client %s requests a task", addrBuffer);
+        type = MSG_GIVE_ME_TASK;
+        if (rowRangeCount < 0)
+            rowRangeCount = 0; // the worker holds the whole library
+    }
+    else
+    {
+        // This is not the first message.
+        // The client must send the ID of the book found at the position given to it.
+
+        Book b;
+        if (ParseMessage(msgBuffer, &b, &seq) == 0)
+        {
+            // skip invalid message
+            return InvalidMessage(library, msgBuffer, clientAddr);
+        }
+
+        int idx = PositionIndex(library, &b.pos);
+        if (idx < 0)
+        {
+            return InvalidMessage(library, msgBuffer, clientAddr);
+        }
+
+        // Acknowledge the result at once, so the worker slows down its retransmissions
+        if (seq >= 0)
+        {
+            char ackBuffer[32] = "ACK ";
+            char *end = CodecFormatInt(ackBuffer + 4, seq);
+            library->send(ackBuffer, end - ackBuffer, clientAddr);
+        }
+
+        if (RepeatReply(library, seq, clientAddr))
+        {
+            return MSG_RESULT;
+        }
+
+        RecordResult(library, &b, idx, addrBuffer);
+        type = MSG_RESULT;
+    }
+
+    Session *session = FindSession(library, clientAddr, 1);
+    session->lastSeen = ClockNowNs();
+    if (rowRangeCount >= 0)
+    {
+        memcpy(session->rows, rows, rowRangeCount * sizeof(*rows));
+        session->rowRangeCount = rowRangeCount;
+        session->rowsKnown = 1;
+    }
+
+    // The worker is served from the same bookshelf while it has tasks. A session
+    // recreated by a result (after it expired) does not know the rows of the worker:
+    // PENDING makes the worker send its task request again.
+    Task task;
+    if (!session->rowsKnown)
+    {
+        sprintf(msgBuffer, "PENDING");
+    }
+    else if (!DispatchTask(library, session, &task))
+    {
+        if (library->ready)
+        {
+            sprintf(msgBuffer, "NO_MORE_TASKS");
+        }
+        else
+        {
+            sprintf(msgBuffer, "PENDING");
+        }
+    }
+    else
+    {
+        LeaseTask(library, session, &task, addrBuffer);
+        TaskCreateMessage(msgBuffer, &task);
+    }
+
+    // Remember the reply, a retransmitted request gets it again
+    if (seq >= 0)
+    {
+        char *end = msgBuffer + strlen(msgBuffer);
+        *end = ':';
+        CodecFormatInt(end + 1, seq);
+        session->lastRequest = seq;
+        strcpy(session->lastReply, msgBuffer);
+    }
+
+    // Send next task
+    library->send(msgBuffer, strlen(msgBuffer), clientAddr);
+    return type;
+}
+
+void UpdateQueues(Library *library)
+{
+    long now = ClockNowNs();
+    long requeuedBefore = library->stats.requeued;
+
+    // Requeue the tasks of the workers which stopped sending heartbeats
+    if (now - library->lastSessionScan >= SESSION_SCAN_PERIOD)
+    {
+        library->lastSessionScan = now;
+        for (int i = library->sessions.size - 1; i >= 0; --i)
+        {
+            Session *session = library->sessions.items[i];
+            if (now - session->lastSeen > SESSION_TIMEOUT)
+            {
+                if (session->lastRequest > 0)
+                {
+                    ClosedSession closed;
+                    closed.addr = session->addr;
+                    closed.lastRequest = session->lastRequest;
+                    strcpy(closed.lastReply, session->lastReply);
+                    closed.closedAt = now;
+                    ClosedSessionSetInsert(&library->closedSessions, closed, NULL);
+                }
+                CloseSession(library, session);
+            }
+        }
+        for (int i = library->closedSessions.size - 1; i >= 0; --i)
+        {
+            ClosedSession *closed = &library->closedSessions.items[i];
+            if (now - closed->closedAt > REPLY_HORIZON)
+            {
+                ClosedSession key = *closed;
+                ClosedSessionSetRemove(&library->closedSessions, &key);
+            }
+        }
+
+        // A full bucket is the same as none
+        for (int i = library->buckets.size - 1; i >= 0; --i)
+        {
+            Bucket *bucket = &library->buckets.items[i];
+            RefillBucket(bucket, now);
+            if (bucket->tokens >= RATE_BURST)
+            {
+                Bucket key = *bucket;
+                BucketSetRemove(&library->buckets, &key);
+            }
+        }
+    }
+
+    // Tasks are queued in dispatch order, so the expired ones are at the front
+    while (!DListEmpty(&library->pendingTaskQueue))
+    {
+        PendingTask *pt = DLIST_ENTRY(DListFront(&library->pendingTaskQueue), PendingTask, link);
+        if (now - pt->dispatchedAt <= LEASE_TIMEOUT)
+            break;
+
+        // Reinsert old uncompleted task into task queue
+        ReleaseTask(library, pt, 1);
+    }
+
+    HistogramRecord(&library->stats.requeue, library->stats.requeued - requeuedBefore);
+}
@@ -0,0 +1,254 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "Address.h"
+#include "DList.h"
+#include "Vector.h"
+#include "Queue.h"
+#include "HashSet.h"
+#include "Histogram.h"
+#include "Clock.h"
+#include "Book.h"
+#include "Task.h"
+#include "Codec.h"
+#include "RowRange.h"
+#include "Log.h"
+
+// Task, lease and catalog logic of the library server. It does not touch sockets
+// or signals: replies go through the send function of the library and the time
+// comes from ClockNowNs(), so the same code runs in Server and in Simulator.
+
+#define MSGMAX 255 /* Longest message string */
+
+#define LEASE_TIMEOUT (5 * NS_PER_SEC)   /* Time given to a worker to complete a task */
+#define SESSION_TIMEOUT (3 * NS_PER_SEC) /* Worker silence after which its tasks are requeued */
+#define SESSION_SCAN_PERIOD NS_PER_SEC   /* How often UpdateQueues looks for silent workers */
+#define REPLY_HORIZON (10 * NS_PER_SEC)  /* Time the last reply of a closed session answers retransmissions */
+
+#define RATE_LIMIT 1000         /* Messages per second taken from one address */
+#define RATE_BURST 200          /* Messages one address may send at once */
+#define INVALID_COST 20         /* Messages an invalid one counts as, garbage runs out of tokens first */
+#define MAX_BUCKETS 65536       /* Addresses followed at once, the others share one bucket */
+#define OVERLOAD_WINDOW (NS_PER_SEC / 10) /* Period the load is measured over */
+#define OVERLOAD_MESSAGES 2000  /* Messages per window above which the observers are not served */
+#define INVALID_LOG_PERIOD NS_PER_SEC     /* At most one warning about invalid messages per period */
+
+DEFINE_VECTOR(Catalog, Book) // Books stored inline, sorted by ID once recovered
+DEFINE_VECTOR_ORDER(Catalog, Book, BookLess)
+DEFINE_QUEUE(TaskQueue, Task) // Queue of the tasks of one bookshelf
+
+typedef struct Observer
+{
+    Address addr;
+} Observer;
+
+// Observers are keyed by address
+#define ObserverHash(obs) AddressHash(&(obs)->addr)
+#define ObserverEqual(obs1, obs2) AddressEqual(&(obs1)->addr, &(obs2)->addr)
+
+DEFINE_HASHSET(ObserverSet, Observer, ObserverHash, ObserverEqual)
+
+// Token bucket limiting the messages taken from one address
+typedef struct Bucket
+{
+    Address addr;
+    double tokens;   // messages the address may still send at once
+    long refilledAt; // time the tokens were last added, ns
+} Bucket;
+
+#define BucketHash(bucket) AddressHash(&(bucket)->addr)
+#define BucketEqual(bucket1, bucket2) AddressEqual(&(bucket1)->addr, &(bucket2)->addr)
+
+DEFINE_HASHSET(BucketSet, Bucket, BucketHash, BucketEqual)
+
+// Recovered books keyed by ID, for the queries
+#define BookIdHash(book) HashInt((book)->id)
+#define BookIdEqual(book1, book2) ((book1)->id == (book2)->id)
+
+DEFINE_HASHSET(BookIdSet, Book, BookIdHash, BookIdEqual)
+
+// Worker session: the tasks leased to a worker which has not disconnected yet
+typedef struct Session
+{
+    Address addr;
+    long lastSeen; // time of the last message (task request, result or heartbeat), ns
+    DList leases;  // pending tasks leased to the worker
+    int shelf;     // bookshelf the worker is served from, -1 if none yet
+    int stealing;  // the shelf belongs to another worker: take its tasks from the back
+    RowRange rows[MAX_ROW_RANGES]; // rows the worker holds, it gets tasks only from them
+    int rowRangeCount;             // 0 if the worker holds the whole library
+    int rowsKnown;                 // a task request has told the rows, until then nothing is dispatched
+    int lastRequest;               // sequence number of the last request answered, 0 if none
+    char lastReply[MSGMAX];        // reply to it, resent if the request is repeated
+} Session;
+
+// Sessions are allocated separately: the leases point into them
+typedef Session *SessionRef;
+#define SessionHash(ref) AddressHash(&(*(ref))->addr)
+#define SessionEqual(ref1, ref2) AddressEqual(&(*(ref1))->addr, &(*(ref2))->addr)
+
+DEFINE_HASHSET(SessionSet, SessionRef, SessionHash, SessionEqual)
+
+// Last reply of a worker whose session was closed for its silence. A late
+// retransmission gets it again instead of being taken for a new request, and
+// a new session of the address goes on with its sequence numbers.
+typedef struct ClosedSession
+{
+    Address addr;
+    int lastRequest;
+    char lastReply[MSGMAX];
+    long closedAt; // ns
+} ClosedSession;
+
+#define ClosedSessionHash(closed) AddressHash(&(closed)->addr)
+#define ClosedSessionEqual(closed1, closed2) AddressEqual(&(closed1)->addr, &(closed2)->addr)
+
+DEFINE_HASHSET(ClosedSessionSet, ClosedSession, ClosedSessionHash, ClosedSessionEqual)
+
+typedef struct PendingTask
+{
+    Task task;
+    long dispatchedAt; // time of the dispatch, ns
+    DLink link;        // link in the pending task queue
+    Session *session;  // worker the task is leased to
+    DLink sessionLink; // link in the leases of the session
+} PendingTask;
+
+typedef struct DList PendingTaskQueue; // Queue of the tasks ordered by dispatch time
+
+// Kinds of the messages received by the server
+typedef enum MessageType
+{
+    MSG_GIVE_ME_TASK,
+    MSG_RESULT,
+    MSG_I_AM_OBSERVER,
+    MSG_DISCONNECT,
+    MSG_HEARTBEAT,
+    MSG_STATS,
+    MSG_CATALOG,
+    MSG_TASKS,
+    MSG_RESULTS,
+    MSG_WHERE,
+    MSG_WHAT,
+    MSG_INVALID,
+    MSG_DROPPED, // over the rate limit of its address, or observer traffic under overload
+    MSG_TYPE_COUNT
+} MessageType;
+
+extern const char *messageTypeNames[MSG_TYPE_COUNT];
+
+// Server statistics, always collected
+typedef struct Stats
+{
+    Histogram service[MSG_TYPE_COUNT]; // handler service time per message type, ns
+    Histogram lease;                   // time from the dispatch of a task to its result, ns
+    Histogram requeue;                 // tasks requeued by each UpdateQueues pass
+    long requeued;                     // tasks requeued for any reason
+    long shelfChanges;                 // times a worker got a new bookshelf
+    long steals;                       // times a worker had to share the bookshelf of another one
+    long duplicateResults;             // results for positions which were already recovered
+    long duplicateRequests;            // repeated requests answered with the remembered reply
+    long rateLimited;                  // messages dropped by the rate limit of their address
+    long invalid;                      // messages which could not be parsed
+    long shed;                         // notifications and registrations of observers dropped under overload
+    long overloads;                    // times the server became overloaded
+    long lookups;                      // IDs and positions looked up by WHERE and WHAT
+} Stats;
+
+// Structure to store all system variables
+typedef struct Library
+{
+    Catalog catalog;     // Recovered books
+    char *recovered;     // recovered flag for each position
+    int *positionIds;    // ID recovered at each position, valid where the flag is set
+    BookIdSet booksById; // the catalog keyed by ID, built once it is complete
+    int catalogFullSize; // M * N * K
+    int firstRow;        // first row served, 0 unless the server is a partition of a federation
+    int M, N, K;         // sizes of the part served, used to compute the index of a position
+    TaskQueue *shelves; // tasks waiting for dispatch, one queue per bookshelf (m, n)
+    int *shelfWorkers;  // number of workers served from each bookshelf
+    int shelfCount;     // M * N
+    int *rowCursor;     // first bookshelf of each row which may still have no worker
+    int nextRow;        // first row whose cursor has not reached its end (counted from firstRow)
+    int queued;         // tasks in all the bookshelf queues
+    PendingTaskQueue pendingTaskQueue;
+    PendingTask **pendingByPos; // pending task for each position, NULL if not pending
+    ObserverSet observers;
+    SessionSet sessions;  // worker sessions keyed by address
+    ClosedSessionSet closedSessions; // sessions closed within REPLY_HORIZON, keyed by address
+    BucketSet buckets;    // rate limits keyed by address
+    Bucket sharedBucket;  // rate limit of the addresses beyond MAX_BUCKETS
+    long windowStart;     // start of the current load measurement window, ns
+    int windowMessages;   // messages received in it
+    int overloaded;       // observer traffic is shed until a window passes below OVERLOAD_MESSAGES
+    long invalidLoggedAt; // time of the last warning about invalid messages, ns
+    long invalidUnlogged; // invalid messages received since
+    long lastSessionScan; // time UpdateQueues last looked for silent workers, ns
+    Stats stats;
+    int ready;
+    int fetched; // the coordinator has read the whole catalog
+
+    // Sends a datagram to a client
+    void (*send)(const char *msg, int msgLen, const Address *addr);
+    // Sends the statistics of the transport with STATS, NULL if it keeps none
+    void (*sendTransportStats)(const Address *addr);
+} Library;
+
+/* Initializes the library*/
+void Initialize(Library *library, int M, int N, int K);
+
+/* Initializes the library to serve only the rows firstRow..lastRow of the M * N * K space */
+void InitializePartition(Library *library, int firstRow, int lastRow, int N, int K);
+
+/* Moves uncompleted tasks from pending queue to task queue */
+void UpdateQueues(Library *library);
+
+/* Finds the session of the worker, creates it if create is set */
+Session *FindSession(Library *library, const Address *addr, int create);
+
+/* Returns the leases of the session to the task queue and deletes the session */
+void CloseSession(Library *library, Session *session);
+
+/* Removes the task from pending queues, returns it to the task queue if requeue is set */
+void ReleaseTask(Library *library, PendingTask *pt, int requeue);
+
+/* Returns the task to the queue of its bookshelf */
+void QueueTask(Library *library, const Task *task);
+
+/* Takes the next task for the worker, returns 0 if no task is queued */
+int DispatchTask(Library *library, Session *session, Task *task);
+
+/* Index of the position in the M * N * K space, -1 if out of range */
+int PositionIndex(Library *library, const Position *pos);
+
+void NotifyObservers(Library *library, const char *msg);
+
+/* Takes the message into account for the rate limit of the address and the overload
+   detection, returns 0 if it must be dropped */
+int AdmitMessage(Library *library, const Address *addr);
+
+/* Handles one message from a client, returns its type. Besides the worker protocol a relay
+   may send "TASKS:<seq> <count>[ <rows>]", answered with "TASKS:<seq> M:N:K..." holding up
+   to count tasks leased to the relay, and "RESULTS:<seq> ID:M:N:K...", answered with "ACK <seq>".
+   Once the catalog is complete it answers the read-only queries "WHERE ID[ ID...]" with
+   "WHERE ID:M:N:K..." ("ID:-" for an unknown ID) and "WHAT M:N:K[ M:N:K...]" with
+   "WHAT ID:M:N:K..." ("-:M:N:K" for a position it does not serve), in the order asked;
+   the items which do not fit into the reply are left out and must be asked again.
+   Before that the queries are answered with "PENDING" */
+MessageType HandleMessage(Library *library, char *msgBuffer, const Address *clientAddr);
+
+/* Sends the statistics to the client, one histogram per datagram, then END_STATS */
+void SendStats(Library *library, const Address *clientAddr);
+
+/* Answers "CATALOG <offset>" from the coordinator: "PENDING <rows> <recovered> <total>" until
+   the catalog is complete, then "BOOKS <offset> ID:M:N:K..." and finally "CATALOG_END <size>" */
+void SendCatalog(Library *library, int offset, const Address *clientAddr);
+
+/* Parse result from client: ID:M:N:K, optionally followed by the sequence number :SEQ (from 1),
+   seq is set to -1 without it */
+int ParseMessage(char *msg, Book *book, int *seq);
+
+/* Print Catalog */
+void PrintCatalog(Library *library);
+
+#endif
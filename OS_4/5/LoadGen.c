@@ -0,0 +1,402 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <sys/socket.h> /* for socket(), sendto(), and recvfrom() */
+#include <sys/epoll.h>  /* for epoll_create1(), epoll_ctl() and epoll_wait() */
+#include <arpa/inet.h>  /* for sockaddr_in and inet_addr() */
+#include <stdlib.h>     /* for atoi(), drand48() and exit() */
+#include <time.h>       /* for clock_gettime() */
+#include <string.h>     /* for strcmp(), strrchr() and stpcpy() */
+#include <unistd.h>     /* for close() */
+#include <fcntl.h>      /* for fcntl() */
+#include <signal.h>     /* for sigaction() and SIGINT */
+
+#include "Book.h"
+#include "Task.h"
+#include "Codec.h"
+#include "IO.h"
+#include "Vector.h"
+#include "Distribution.h"
+
+#define MSGMAX 255               /* Longest message string */
+#define PENDING_RETRY_MS 2000    /* Delay before asking again after PENDING, as Worker does */
+#define REPLY_TIMEOUT_MS 5000    /* Re-send the request if the server did not answer */
+#define HEARTBEAT_PERIOD_MS 1000 /* Heartbeats of the busy workers, as Worker does */
+
+// Load generator: simulates many workers from one process, each worker
+// uses its own UDP socket (and so its own source port)
+
+typedef enum WorkerState
+{
+    WAITING_REPLY, // request sent, waiting for the server
+    BUSY,          // "looking for" the book until the event fires
+    SLEEPING,      // got PENDING, will ask again when the event fires
+    THROTTLED,     // has a request to send, waiting for the rate limiter
+    FINISHED       // got NO_MORE_TASKS
+} WorkerState;
+
+typedef struct SimWorker
+{
+    int sock;
+    WorkerState state;
+    long sentAt;          // time the outstanding request was sent
+    long wakeAt;          // time the BUSY or SLEEPING state ends
+    int seq;              // sequence number of the request, as Worker numbers them
+    char msg[MSGMAX + 1]; // the request to send or re-send, ending with ":SEQ"
+} SimWorker;
+
+typedef struct Event
+{
+    long at; // time in nanoseconds
+    int worker;
+} Event;
+
+#define EventLess(e1, e2) ((e1)->at < (e2)->at)
+#define LongLess(a, b) (*(a) < *(b))
+
+DEFINE_VECTOR(Timers, Event)
+DEFINE_VECTOR_HEAP(Timers, Event, EventLess)
+DEFINE_VECTOR(Samples, long)
+DEFINE_VECTOR_ORDER(Samples, long, LongLess)
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+long NowNs();
+// Write the next request of the worker: the body followed by its new sequence number
+void SetRequest(SimWorker *w, const char *body);
+// Load the library file into a dense array indexed by position
+int *LoadLibrary(const char *filename, int *M, int *N, int *K);
+void PrintReport(double seconds);
+
+volatile sig_atomic_t interrupted = 0;
+void SIGINTHandler(int signalType) { (void)signalType; interrupted = 1; }
+
+/* Statistics */
+Samples latencies;     // request -> reply latency, ns
+long requestsSent = 0; // GIVE_ME_TASK and results, including re-sends
+long repliesReceived = 0;
+long tasksCompleted = 0;
+long pendingReplies = 0;
+long acksReceived = 0;  // results acknowledged ahead of their task reply
+long staleReplies = 0;  // replies to requests which were already answered
+long timeouts = 0;
+long heartbeatsSent = 0;
+
+int main(int argc, char *argv[])
+{
+    Address libServAddr;       /* Library server address */
+    Address fromAddr;          /* Source address of response */
+    char inBuffer[MSGMAX + 1]; /* Buffer for receiving response */
+    struct sigaction handler;  /* Signal handling action definition */
+
+    // The server address takes one or two arguments, the others follow it
+    int addrArgs = AddressFromArgs(argv + 1, argc - 1, &libServAddr);
+    char **args = argv + 1 + addrArgs;
+    int argCount = argc - 1 - addrArgs;
+
+    if (addrArgs == 0 || argCount < 2 || argCount > 4)
+    {
+        fprintf(stderr, "Usage: %s <Server IP> <Server Port> <Library Filename> <Workers> [<Rate> [<Service Time>]]\n", argv[0]);
+        fprintf(stderr, "       %s unix:<Server Socket Path> <Library Filename> <Workers> [<Rate> [<Service Time>]]\n", argv[0]);
+        fprintf(stderr, "  Rate: requests per second over all workers, 0 for unlimited (default)\n");
+        fprintf(stderr, "  Service Time, ms: fixed:T | uniform:MIN:MAX (default uniform:1000:3000) | exp:MEAN\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const int workerCount = atoi(args[1]);
+    const double rate = argCount > 2 ? atof(args[2]) : 0;
+    Distribution serviceTime = {DIST_UNIFORM, 1000, 3000}; // ms
+    if (argCount > 3 && !DistributionParse(args[3], &serviceTime))
+    {
+        fprintf(stderr, "Invalid service time '%s'\n", args[3]);
+        exit(EXIT_FAILURE);
+    }
+
+    int M, N, K;
+    int *ids = LoadLibrary(args[0], &M, &N, &K);
+
+    handler.sa_handler = SIGINTHandler;
+    sigemptyset(&handler.sa_mask);
+    handler.sa_flags = 0;
+    if (sigaction(SIGINT, &handler, 0) < 0)
+        DieWithError("sigaction() failed for SIGINT");
+
+    srand48(time(NULL));
+    SamplesInit(&latencies);
+    Timers timers;
+    TimersInit(&timers);
+
+    int epfd = epoll_create1(0);
+    if (epfd < 0)
+        DieWithError("epoll_create1() failed");
+
+    SimWorker *workers = calloc(workerCount, sizeof(*workers));
+    for (int i = 0; i < workerCount; ++i)
+    {
+        workers[i].sock = CreateClientSocket(&libServAddr);
+        if (fcntl(workers[i].sock, F_SETFL, O_NONBLOCK) < 0)
+            DieWithError("Unable to put socket into non-blocking mode");
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, workers[i].sock, &ev) < 0)
+            DieWithError("epoll_ctl() failed");
+
+        SetRequest(&workers[i], "GIVE_ME_TASK");
+        workers[i].state = THROTTLED;
+    }
+
+    // Token bucket of the rate limiter: one token per request
+    double tokens = 1;
+    const double burst = rate > 0 && rate < workerCount ? rate : workerCount;
+    long lastRefill = NowNs();
+
+    const long start = NowNs();
+    long nextHeartbeat = start + HEARTBEAT_PERIOD_MS * 1000000L;
+    int finished = 0;
+    int throttled = workerCount;
+    int cursor = 0; // round-robin over the throttled workers
+
+    while (finished < workerCount && !interrupted)
+    {
+        long now = NowNs();
+
+        // Send the requests which the rate limiter allows
+        if (rate > 0)
+        {
+            tokens += (now - lastRefill) * 1e-9 * rate;
+            if (tokens > burst)
+                tokens = burst;
+            lastRefill = now;
+        }
+        for (int scanned = 0; throttled > 0 && scanned < workerCount && (rate <= 0 || tokens >= 1); ++scanned)
+        {
+            SimWorker *w = &workers[cursor];
+            if (w->state == THROTTLED)
+            {
+                SendTo(w->sock, w->msg, strlen(w->msg), &libServAddr);
+                w->state = WAITING_REPLY;
+                w->sentAt = now;
+                requestsSent += 1;
+                tokens -= 1;
+                throttled -= 1;
+                Event ev = {now + REPLY_TIMEOUT_MS * 1000000L, cursor};
+                TimersHeapPush(&timers, ev);
+            }
+            cursor = (cursor + 1) % workerCount;
+        }
+
+        // Heartbeats keep the sessions of the busy workers alive
+        if (now >= nextHeartbeat)
+        {
+            for (int i = 0; i < workerCount; ++i)
+            {
+                if (workers[i].state == BUSY)
+                {
+                    SendTo(workers[i].sock, "HEARTBEAT", strlen("HEARTBEAT"), &libServAddr);
+                    heartbeatsSent += 1;
+                }
+            }
+            nextHeartbeat += HEARTBEAT_PERIOD_MS * 1000000L;
+        }
+
+        // Fire the due timers
+        while (timers.size > 0 && timers.data[0].at <= now)
+        {
+            Event ev = TimersHeapPop(&timers);
+            SimWorker *w = &workers[ev.worker];
+            if (w->state == WAITING_REPLY && now - w->sentAt >= REPLY_TIMEOUT_MS * 1000000L)
+            {
+                timeouts += 1;
+                w->state = THROTTLED;
+                throttled += 1;
+            }
+            else if ((w->state == BUSY || w->state == SLEEPING) && ev.at == w->wakeAt)
+            {
+                w->state = THROTTLED;
+                throttled += 1;
+            }
+        }
+
+        // Wait for replies until the next timer
+        long wakeAt = nextHeartbeat;
+        if (timers.size > 0 && timers.data[0].at < wakeAt)
+            wakeAt = timers.data[0].at;
+        int timeoutMs = (wakeAt - NowNs()) / 1000000L;
+        if (throttled > 0)
+            timeoutMs = 1;
+        if (timeoutMs < 0)
+            timeoutMs = 0;
+
+        struct epoll_event events[64];
+        int n = epoll_wait(epfd, events, 64, timeoutMs);
+        now = NowNs();
+        for (int e = 0; e < n; ++e)
+        {
+            int idx = events[e].data.u32;
+            SimWorker *w = &workers[idx];
+
+            int responseLen = MSGMAX;
+            while (RecvFromUnblocked(w->sock, inBuffer, &responseLen, &fromAddr))
+            {
+                inBuffer[responseLen] = '\0';
+                responseLen = MSGMAX;
+                if (w->state != WAITING_REPLY)
+                    continue; // late reply to a re-sent request
+
+                // The server has the result, its task reply follows
+                int seq;
+                if (strncmp(inBuffer, "ACK ", 4) == 0 && CodecParseInt(inBuffer + 4, &seq))
+                {
+                    acksReceived += seq == w->seq;
+                    continue;
+                }
+
+                // Replies end with the sequence number of their request
+                char *colon = strrchr(inBuffer, ':');
+                if (!colon || !CodecParseInt(colon + 1, &seq) || seq != w->seq)
+                {
+                    staleReplies += 1;
+                    continue;
+                }
+                *colon = '\0';
+
+                repliesReceived += 1;
+                SamplesPushBack(&latencies, now - w->sentAt);
+
+                Task task;
+                if (strcmp(inBuffer, "NO_MORE_TASKS") == 0)
+                {
+                    w->state = FINISHED;
+                    finished += 1;
+                }
+                else if (strcmp(inBuffer, "PENDING") == 0)
+                {
+                    pendingReplies += 1;
+                    SetRequest(w, "GIVE_ME_TASK");
+                    w->state = SLEEPING;
+                    w->wakeAt = now + PENDING_RETRY_MS * 1000000L;
+                    Event ev = {w->wakeAt, idx};
+                    TimersHeapPush(&timers, ev);
+                }
+                else if (TaskParse(inBuffer, &task) && task.m >= 0 && task.m < M &&
+                         task.n >= 0 && task.n < N && task.k >= 0 && task.k < K)
+                {
+                    int fields[4] = {ids[(task.m * N + task.n) * K + task.k], task.m, task.n, task.k};
+                    char result[MSGMAX + 1];
+                    CodecFormatFields(result, ':', fields, 4);
+                    SetRequest(w, result);
+                    tasksCompleted += 1;
+                    w->state = BUSY;
+                    w->wakeAt = now + (long)(DistributionSample(&serviceTime) * 1000000.0);
+                    Event ev = {w->wakeAt, idx};
+                    TimersHeapPush(&timers, ev);
+                }
+                else
+                {
+                    fprintf(stderr, "Warning: unexpected reply \"%s\"\n", inBuffer);
+                    SetRequest(w, "GIVE_ME_TASK");
+                    w->state = THROTTLED;
+                    throttled += 1;
+                }
+            }
+        }
+    }
+
+    PrintReport((NowNs() - start) * 1e-9);
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        if (workers[i].state != FINISHED)
+            SendTo(workers[i].sock, "DISCONNECT", strlen("DISCONNECT"), &libServAddr);
+        close(workers[i].sock);
+    }
+    close(epfd);
+    free(workers);
+    free(ids);
+    TimersFree(&timers);
+    SamplesFree(&latencies);
+
+    return EXIT_SUCCESS;
+}
+
+void SetRequest(SimWorker *w, const char *body)
+{
+    char *end = stpcpy(w->msg, body);
+    *end++ = ':';
+    w->seq += 1;
+    CodecFormatInt(end, w->seq);
+}
+
+long NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int *LoadLibrary(const char *filename, int *M, int *N, int *K)
+{
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to open file '%s'\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    Book *books = NULL;
+    int count = 0, capacity = 0;
+    *M = *N = *K = 0;
+
+    Book book;
+    while (fscanf(fp, "%d:%d:%d:%d", &book.pos.m, &book.pos.n, &book.pos.k, &book.id) == 4)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 1024;
+            books = realloc(books, capacity * sizeof(*books));
+        }
+        books[count++] = book;
+        if (book.pos.m >= *M) *M = book.pos.m + 1;
+        if (book.pos.n >= *N) *N = book.pos.n + 1;
+        if (book.pos.k >= *K) *K = book.pos.k + 1;
+    }
+    fclose(fp);
+
+    int *ids = calloc((size_t)*M * *N * *K, sizeof(*ids));
+    for (int i = 0; i < count; ++i)
+    {
+        ids[(books[i].pos.m * *N + books[i].pos.n) * *K + books[i].pos.k] = books[i].id;
+    }
+    free(books);
+    return ids;
+}
+
+void PrintReport(double seconds)
+{
+    SamplesSort(&latencies);
+
+    printf("elapsed_s=%.3f\n", seconds);
+    printf("requests_sent=%ld\n", requestsSent);
+    printf("replies_received=%ld\n", repliesReceived);
+    printf("tasks_completed=%ld\n", tasksCompleted);
+    printf("pending_replies=%ld\n", pendingReplies);
+    printf("acks_received=%ld\n", acksReceived);
+    printf("stale_replies=%ld\n", staleReplies);
+    printf("timeouts=%ld\n", timeouts);
+    printf("heartbeats_sent=%ld\n", heartbeatsSent);
+    printf("throughput_replies_per_s=%.1f\n", seconds > 0 ? repliesReceived / seconds : 0);
+
+    static const double percentiles[] = {50, 90, 99, 99.9, 100};
+    for (int i = 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); ++i)
+    {
+        long value = 0;
+        if (latencies.size > 0)
+        {
+            int rank = (int)(percentiles[i] / 100.0 * (latencies.size - 1) + 0.5);
+            value = latencies.data[rank];
+        }
+        printf("latency_p%g_us=%.1f\n", percentiles[i], value / 1000.0);
+    }
+}
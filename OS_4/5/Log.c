@@ -0,0 +1,180 @@
+#include "Log.h"
+#include <stdio.h>     /* for fwrite() and vsnprintf() */
+#include <stdlib.h>    /* for calloc() */
+#include <string.h>    /* for strcmp() */
+#include <stdarg.h>    /* for va_list */
+#include <stdatomic.h> /* for atomic_long */
+#include <pthread.h>   /* for pthread_create() */
+#include <semaphore.h> /* for sem_post(), which is async-signal-safe */
+#include <signal.h>    /* for pthread_sigmask() */
+
+// Bounded multi-producer queue of D. Vyukov: the sequence number of a slot tells
+// whether it is free for the writer of position pos (seq == pos) or holds the line
+// of that writer (seq == pos + 1). The only reader is the flusher thread.
+
+typedef struct LogRecord
+{
+    char line[LOG_LINE_MAX];
+} LogRecord;
+
+int logLevel = -1;
+
+static atomic_long *sequences; // separate from the records, which are touched only when used
+static LogRecord *records;
+static atomic_long writePos;
+static long readPos; // owned by the flusher
+static atomic_long dropped;
+static atomic_int stopping;
+static sem_t wakeup; // posted once per written line
+static pthread_t flusher;
+
+static const char *levelNames[] = {"error", "warn", "info", "debug"};
+
+int LogLevelParse(const char *name)
+{
+    for (int level = LOG_ERROR; level <= LOG_DEBUG; ++level)
+    {
+        if (strcmp(name, levelNames[level]) == 0)
+            return level;
+    }
+    return -1;
+}
+
+// Writes out the lines which are ready, returns their number
+static int Drain()
+{
+    int count = 0;
+    for (;;)
+    {
+        atomic_long *seq = &sequences[readPos & (LOG_CAPACITY - 1)];
+        if (atomic_load_explicit(seq, memory_order_acquire) != readPos + 1)
+            break; // empty, or the writer has not finished yet
+
+        LogRecord *record = &records[readPos & (LOG_CAPACITY - 1)];
+        fputs(record->line, stdout);
+        fputc('\n', stdout);
+
+        atomic_store_explicit(seq, readPos + LOG_CAPACITY, memory_order_release);
+        ++readPos;
+        ++count;
+    }
+    return count;
+}
+
+static void *Flush(void *arg)
+{
+    (void)arg;
+    long reportedDrops = 0;
+    for (;;)
+    {
+        sem_wait(&wakeup);
+        int stop = atomic_load(&stopping);
+
+        if (Drain() > 0 || stop)
+        {
+            long drops = atomic_load(&dropped);
+            if (drops != reportedDrops)
+            {
+                printf("Warning! %ld log lines dropped\n", drops - reportedDrops);
+                reportedDrops = drops;
+            }
+            fflush(stdout);
+        }
+        if (stop)
+            return NULL;
+    }
+}
+
+void LogStart(LogLevel level)
+{
+    sequences = malloc(LOG_CAPACITY * sizeof(*sequences));
+    records = malloc(LOG_CAPACITY * sizeof(*records));
+    for (long i = 0; i < LOG_CAPACITY; ++i)
+    {
+        atomic_init(&sequences[i], i);
+    }
+    atomic_init(&writePos, 0);
+    atomic_init(&dropped, 0);
+    atomic_init(&stopping, 0);
+    readPos = 0;
+    sem_init(&wakeup, 0, 0);
+
+    // The flusher inherits a mask blocking all signals, so that SIGIO is
+    // always handled by the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_create(&flusher, NULL, Flush, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    logLevel = level;
+}
+
+void LogStop()
+{
+    if (logLevel < 0)
+        return;
+    logLevel = -1;
+    atomic_store(&stopping, 1);
+    sem_post(&wakeup);
+    pthread_join(flusher, NULL);
+    sem_destroy(&wakeup);
+    free(sequences);
+    free(records);
+}
+
+void LogWrite(LogLevel level, const char *line)
+{
+    if (!LOG_ENABLED(level))
+        return;
+
+    long pos = atomic_load_explicit(&writePos, memory_order_relaxed);
+    atomic_long *seq;
+    for (;;)
+    {
+        seq = &sequences[pos & (LOG_CAPACITY - 1)];
+        long diff = atomic_load_explicit(seq, memory_order_acquire) - pos;
+        if (diff == 0)
+        {
+            // The slot is free, claim it
+            if (atomic_compare_exchange_weak_explicit(&writePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // The ring is full
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            // Another writer took the slot
+            pos = atomic_load_explicit(&writePos, memory_order_relaxed);
+        }
+    }
+
+    LogRecord *record = &records[pos & (LOG_CAPACITY - 1)];
+    strncpy(record->line, line, LOG_LINE_MAX - 1);
+    record->line[LOG_LINE_MAX - 1] = '\0';
+
+    atomic_store_explicit(seq, pos + 1, memory_order_release);
+    sem_post(&wakeup);
+}
+
+void LogPrintf(LogLevel level, const char *format, ...)
+{
+    if (!LOG_ENABLED(level))
+        return;
+
+    char line[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    LogWrite(level, line);
+}
+
+long LogDropped()
+{
+    return logLevel < 0 ? 0 : atomic_load(&dropped);
+}
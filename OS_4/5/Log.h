@@ -0,0 +1,42 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Asynchronous log. Writers copy preformatted lines into a bounded lock-free ring
+// and never block: when the ring is full the line is dropped and counted. A
+// background thread writes the lines to stdout. LogWrite() only copies and uses
+// atomics, so the SIGIO handler may log while the main thread is logging too.
+// Until LogStart() is called nothing is logged.
+
+typedef enum LogLevel
+{
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} LogLevel;
+
+#define LOG_LINE_MAX 120       /* Longer lines are truncated */
+#define LOG_CAPACITY (1 << 16) /* Lines the ring holds, a power of two */
+
+extern int logLevel; // lines above this level are skipped, -1 before LogStart()
+
+// Checks the level before the caller spends time formatting the line
+#define LOG_ENABLED(level) ((int)(level) <= logLevel)
+
+// Parses "error", "warn", "info" or "debug", returns -1 if the name is unknown
+int LogLevelParse(const char *name);
+
+// Starts the flusher thread
+void LogStart(LogLevel level);
+
+// Writes the remaining lines and stops the flusher thread
+void LogStop();
+
+void LogWrite(LogLevel level, const char *line);
+
+void LogPrintf(LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Lines dropped because the ring was full
+long LogDropped();
+
+#endif
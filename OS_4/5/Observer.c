@@ -19,27 +19,24 @@ void DieWithError(char *errorMessage); /* External error handling function */
 
 void SIGINTHandler(int);
 
-int sock;                       /* Socket descriptor - GLOBAL for SIGINTHandler */
-struct sockaddr_in libServAddr; /* Library server address - GLOBAL for SIGINTHandler */
+int sock;            /* Socket descriptor - GLOBAL for SIGINTHandler */
+Address libServAddr; /* Library server address - GLOBAL for SIGINTHandler */
 
 int main(int argc, char *argv[])
 {
-    struct sockaddr_in fromAddr; /* Source address of response */
-    unsigned short libServPort;  /* Library server port */
-    char *servIP;                /* IP address of server */
+    Address fromAddr;            /* Source address of response */
     char buffer[MSGMAX + 1];     /* Buffer for storing message */
     int msgLen;                  /* Length of received response */
     struct sigaction handler;    /* Signal handling action definition */
 
-    if (argc != 3) /* Test for correct number of arguments */
+    /* Args: server IP address (dotted quad) and port, or its Unix-domain socket */
+    if (AddressFromArgs(argv + 1, argc - 1, &libServAddr) != argc - 1) /* Test for correct number of arguments */
     {
         fprintf(stderr, "Usage: %s <Server IP> <Server Port>\n", argv[0]);
+        fprintf(stderr, "       %s unix:<Server Socket Path>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    servIP = argv[1];            /* First arg: server IP address (dotted quad) */
-    libServPort = atoi(argv[2]); /* Second arg: server port */
-
     /* Set signal handler for SIGTERM */
     handler.sa_handler = SIGINTHandler;
     /* Create mask that mask all signals */
@@ -51,15 +48,8 @@ int main(int argc, char *argv[])
     if (sigaction(SIGINT, &handler, 0) < 0)
         DieWithError("sigaction() failed for SIGINT");
 
-    /* Create a datagram/UDP socket */
-    if ((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
-        DieWithError("socket() failed");
-
-    /* Construct the server address structure */
-    memset(&libServAddr, 0, sizeof(libServAddr));    /* Zero out structure */
-    libServAddr.sin_family = AF_INET;                /* Internet addr family */
-    libServAddr.sin_addr.s_addr = inet_addr(servIP); /* Server IP address */
-    libServAddr.sin_port = htons(libServPort);       /* Server port */
+    /* Create a datagram socket of the server's family */
+    sock = CreateClientSocket(&libServAddr);
 
     // Send initial message "I_AM_OBSERVER"
     sprintf(buffer, "I_AM_OBSERVER");
@@ -70,7 +60,7 @@ int main(int argc, char *argv[])
         msgLen = MSGMAX;
         RecvFrom(sock, buffer, &msgLen, &fromAddr);
 
-        if (libServAddr.sin_addr.s_addr != fromAddr.sin_addr.s_addr)
+        if (!AddressFromServer(&libServAddr, &fromAddr))
         {
             fprintf(stderr, "Warning: received a packet from unknown source.\n");
             continue;
@@ -94,6 +84,7 @@ int main(int argc, char *argv[])
 
 void SIGINTHandler(int signalType)
 {
+    (void)signalType;
     printf("\nSIGINT received, notify the server.\n");
     SendTo(sock, "DISCONNECT", strlen("DISCONNECT"), &libServAddr);
     exit(EXIT_SUCCESS);
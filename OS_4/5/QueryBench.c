@@ -0,0 +1,289 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <stdlib.h>     /* for atoi(), random() and exit() */
+#include <string.h>     /* for strcmp() */
+#include <unistd.h>     /* for close() */
+#include <fcntl.h>      /* for fcntl() */
+#include <poll.h>       /* for poll() */
+
+#include "Address.h"
+#include "IO.h"
+#include "BookIndex.h"
+#include "Codec.h"
+#include "Clock.h"
+#include "Histogram.h"
+
+// Query benchmark: many clients, each with its own socket, keep one WHERE or WHAT
+// batch outstanding against a server whose catalog is complete (started with a
+// long Serve Time, e.g. "-s forever"). Every answer is checked against the library file.
+
+#define MSGMAX 255             /* Longest message string */
+#define MAX_CLIENTS 1024
+#define MAX_BATCH 32           /* Items in one query, fewer if they do not fit */
+#define REPLY_TIMEOUT_MS 1000  /* Ask again if the server did not answer */
+#define PENDING_RETRY_MS 200   /* Delay before asking again after PENDING */
+
+typedef enum QueryMode
+{
+    QUERY_WHERE,
+    QUERY_WHAT,
+    QUERY_MIXED // the clients alternate
+} QueryMode;
+
+typedef struct Client
+{
+    int sock;
+    int where;            // kind of the outstanding query
+    int count;            // items asked
+    long keys[MAX_BATCH]; // position indices of the items
+    long sentAt;          // ns
+    long retryAt;         // ns, time to send the query again
+    char msg[MSGMAX + 1];
+} Client;
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// Write a new query of random books for the client and send it
+void SendQuery(Client *client, int where);
+// Check the reply of the client, returns 0 if it answers an older query
+int CheckReply(Client *client, const char *reply);
+// Book at the position index of the library
+void BookAt(long idx, Book *book);
+
+Address libServAddr;
+BookIndex libraryIndex;
+int batch;
+
+/* Statistics */
+Histogram latency;     // query -> reply, ns
+long queriesSent = 0;  // including re-sends
+long repliesReceived = 0;
+long staleReplies = 0;
+long pendingReplies = 0;
+long timeouts = 0;
+long lookups = 0;      // items answered
+long wrong = 0;        // items answered differently than the library file says
+
+int main(int argc, char *argv[])
+{
+    static Client clients[MAX_CLIENTS];
+    int addrArgs;
+
+    /* First args: server IP address (dotted quad) and port, or its Unix-domain socket */
+    addrArgs = AddressFromArgs(argv + 1, argc - 1, &libServAddr);
+    if (addrArgs == 0 || argc < 5 + addrArgs || argc > 6 + addrArgs)
+    {
+        fprintf(stderr, "Usage: %s <Server IP> <Server Port> <Library Filename> <Clients> <Batch> <Seconds> [where | what | mixed]\n", argv[0]);
+        fprintf(stderr, "       %s unix:<Server Socket Path> <Library Filename> <Clients> <Batch> <Seconds> [where | what | mixed]\n", argv[0]);
+        fprintf(stderr, "  The server must hold the whole library of the file and keep its catalog long enough\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char **args = argv + 1 + addrArgs;
+    const char *filename = args[0];
+    const int clientCount = atoi(args[1]);
+    batch = atoi(args[2]);
+    const double seconds = atof(args[3]);
+    QueryMode mode = QUERY_MIXED;
+    if (argc == 6 + addrArgs)
+    {
+        if (strcmp(args[4], "where") == 0)
+            mode = QUERY_WHERE;
+        else if (strcmp(args[4], "what") == 0)
+            mode = QUERY_WHAT;
+        else if (strcmp(args[4], "mixed") != 0)
+        {
+            fprintf(stderr, "Unknown query mode '%s'\n", args[4]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (clientCount <= 0 || clientCount > MAX_CLIENTS || batch <= 0 || batch > MAX_BATCH || seconds <= 0)
+    {
+        fprintf(stderr, "Clients must be 1 - %d, Batch 1 - %d and Seconds positive\n", MAX_CLIENTS, MAX_BATCH);
+        exit(EXIT_FAILURE);
+    }
+
+    long books = BookIndexLoad(&libraryIndex, filename, sysconf(_SC_NPROCESSORS_ONLN));
+    if (books <= 0 || books != (long)(libraryIndex.rows.last - libraryIndex.rows.first + 1) * libraryIndex.N * libraryIndex.K)
+    {
+        fprintf(stderr, "Library file '%s' is empty, invalid or has gaps\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    HistogramInit(&latency);
+    srandom(1);
+
+    struct pollfd *pfds = malloc(clientCount * sizeof(*pfds));
+    for (int i = 0; i < clientCount; ++i)
+    {
+        clients[i].sock = CreateClientSocket(&libServAddr);
+        if (fcntl(clients[i].sock, F_SETFL, O_NONBLOCK) < 0)
+            DieWithError("fcntl() failed");
+        pfds[i].fd = clients[i].sock;
+        pfds[i].events = POLLIN;
+        SendQuery(&clients[i], mode == QUERY_MIXED ? i % 2 == 0 : mode == QUERY_WHERE);
+    }
+
+    const long start = ClockNowNs();
+    const long end = start + (long)(seconds * NS_PER_SEC);
+
+    for (long now = start; now < end; now = ClockNowNs())
+    {
+        // Sleep until a reply comes or the earliest retry is due
+        long wakeAt = end;
+        for (int i = 0; i < clientCount; ++i)
+        {
+            if (clients[i].retryAt < wakeAt)
+                wakeAt = clients[i].retryAt;
+        }
+        int timeoutMs = wakeAt > now ? (wakeAt - now + NS_PER_MS - 1) / NS_PER_MS : 0;
+        if (poll(pfds, clientCount, timeoutMs) < 0)
+            DieWithError("poll() failed");
+        now = ClockNowNs();
+
+        for (int i = 0; i < clientCount; ++i)
+        {
+            Client *client = &clients[i];
+            char reply[MSGMAX + 1];
+            int replyLen = MSGMAX;
+            Address fromAddr;
+
+            while ((pfds[i].revents & POLLIN) && RecvFromUnblocked(client->sock, reply, &replyLen, &fromAddr))
+            {
+                reply[replyLen] = '\0';
+                replyLen = MSGMAX;
+                repliesReceived += 1;
+
+                if (strcmp(reply, "PENDING") == 0)
+                {
+                    pendingReplies += 1;
+                    client->retryAt = now + PENDING_RETRY_MS * NS_PER_MS;
+                    continue;
+                }
+                if (!CheckReply(client, reply))
+                {
+                    staleReplies += 1;
+                    continue;
+                }
+                HistogramRecord(&latency, now - client->sentAt);
+                SendQuery(client, mode == QUERY_MIXED ? !client->where : mode == QUERY_WHERE);
+            }
+
+            if (now >= client->retryAt)
+            {
+                // Lost, or the server was not ready: the same query again
+                if (now - client->sentAt >= REPLY_TIMEOUT_MS * NS_PER_MS)
+                    timeouts += 1;
+                client->sentAt = now;
+                client->retryAt = now + REPLY_TIMEOUT_MS * NS_PER_MS;
+                SendTo(client->sock, client->msg, strlen(client->msg), &libServAddr);
+                queriesSent += 1;
+            }
+        }
+    }
+
+    double elapsed = (ClockNowNs() - start) * 1e-9;
+    char buffer[MSGMAX];
+
+    printf("clients=%d batch=%d mode=%s seconds=%.1f\n", clientCount, batch,
+           mode == QUERY_WHERE ? "where" : mode == QUERY_WHAT ? "what" : "mixed", elapsed);
+    printf("queries=%ld replies=%ld stale=%ld pending=%ld timeouts=%ld\n",
+           queriesSent, repliesReceived, staleReplies, pendingReplies, timeouts);
+    printf("lookups=%ld lookups_per_sec=%.0f queries_per_sec=%.0f wrong=%ld\n",
+           lookups, lookups / elapsed, latency.count / elapsed, wrong);
+    HistogramFormat(&latency, "latency_us", 1000, buffer, sizeof(buffer));
+    printf("%s\n", buffer);
+
+    for (int i = 0; i < clientCount; ++i)
+        close(clients[i].sock);
+    free(pfds);
+    BookIndexFree(&libraryIndex);
+    exit(wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void BookAt(long idx, Book *book)
+{
+    Position pos;
+    pos.k = idx % libraryIndex.K;
+    pos.n = idx / libraryIndex.K % libraryIndex.N;
+    pos.m = libraryIndex.rows.first + idx / libraryIndex.K / libraryIndex.N;
+    BookIndexFind(&libraryIndex, &pos, book);
+}
+
+void SendQuery(Client *client, int where)
+{
+    long books = (long)(libraryIndex.rows.last - libraryIndex.rows.first + 1) * libraryIndex.N * libraryIndex.K;
+    char *end = stpcpy(client->msg, where ? "WHERE" : "WHAT");
+
+    // As many random books as fit
+    client->where = where;
+    client->count = 0;
+    while (client->count < batch)
+    {
+        char item[3 * CODEC_INT_MAX + 3];
+        char *itemEnd;
+        Book book;
+        long idx = random() % books;
+
+        BookAt(idx, &book);
+        if (where)
+        {
+            itemEnd = CodecFormatInt(item, book.id);
+        }
+        else
+        {
+            int pos[3] = {book.pos.m, book.pos.n, book.pos.k};
+            itemEnd = CodecFormatFields(item, ':', pos, 3);
+        }
+        if (end - client->msg + 1 + (itemEnd - item) > MSGMAX)
+            break;
+        *end++ = ' ';
+        memcpy(end, item, itemEnd - item + 1);
+        end += itemEnd - item;
+        client->keys[client->count++] = idx;
+    }
+
+    client->sentAt = ClockNowNs();
+    client->retryAt = client->sentAt + REPLY_TIMEOUT_MS * NS_PER_MS;
+    SendTo(client->sock, client->msg, end - client->msg, &libServAddr);
+    queriesSent += 1;
+}
+
+int CheckReply(Client *client, const char *reply)
+{
+    const char *command = client->where ? "WHERE" : "WHAT";
+    size_t commandLen = strlen(command);
+    if (strncmp(reply, command, commandLen) != 0)
+        return 0;
+
+    const char *str = reply + commandLen;
+    int answered = 0;
+    while (*str == ' ' && answered < client->count)
+    {
+        Book expected;
+        BookAt(client->keys[answered], &expected);
+
+        // "ID:M:N:K", or "ID:-" and "-:M:N:K" for an unknown half
+        int fields[4];
+        int found = CodecParseFields(str + 1, ':', fields, 4, &str) == 4;
+        if (!found)
+        {
+            while (*str != ' ' && *str != '\0')
+                ++str;
+        }
+
+        // A reply to an older query is told apart by its first item
+        int asked = client->where ? found && fields[0] == expected.id : found && fields[1] == expected.pos.m &&
+                                                                        fields[2] == expected.pos.n && fields[3] == expected.pos.k;
+        if (answered == 0 && found && !asked)
+            return 0;
+        if (!found || fields[0] != expected.id || fields[1] != expected.pos.m ||
+            fields[2] != expected.pos.n || fields[3] != expected.pos.k)
+            wrong += 1;
+        answered += 1;
+    }
+
+    lookups += answered;
+    return 1;
+}
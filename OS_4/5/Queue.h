@@ -0,0 +1,93 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdlib.h>
+#include <assert.h>
+
+// Typed FIFO queue stored inline in a growable ring buffer.
+// DEFINE_QUEUE(Name, Type) generates the type Name and the functions Name##Init,
+// Name##Free, Name##Empty, Name##Size, Name##PushBack, Name##PopFront, Name##Front,
+// Name##PopBack and Name##Back.
+#define DEFINE_QUEUE(Name, Type)                                               \
+    typedef struct Name                                                        \
+    {                                                                          \
+        Type *data;                                                            \
+        int head;     /* index of the first element */                         \
+        int size;                                                              \
+        int capacity; /* always a power of two */                              \
+    } Name;                                                                    \
+                                                                               \
+    static inline void Name##Init(Name *q)                                     \
+    {                                                                          \
+        q->data = NULL;                                                        \
+        q->head = 0;                                                           \
+        q->size = 0;                                                           \
+        q->capacity = 0;                                                       \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Free(Name *q)                                     \
+    {                                                                          \
+        free(q->data);                                                         \
+        Name##Init(q);                                                         \
+    }                                                                          \
+                                                                               \
+    static inline int Name##Empty(const Name *q)                               \
+    {                                                                          \
+        return q->size == 0;                                                   \
+    }                                                                          \
+                                                                               \
+    static inline int Name##Size(const Name *q)                                \
+    {                                                                          \
+        return q->size;                                                        \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Grow(Name *q)                                     \
+    {                                                                          \
+        int capacity = q->capacity ? 2 * q->capacity : 16;                     \
+        Type *data = malloc(capacity * sizeof(Type));                          \
+        assert(data);                                                          \
+        for (int i = 0; i < q->size; ++i)                                      \
+            data[i] = q->data[(q->head + i) & (q->capacity - 1)];              \
+        free(q->data);                                                         \
+        q->data = data;                                                        \
+        q->head = 0;                                                           \
+        q->capacity = capacity;                                                \
+    }                                                                          \
+                                                                               \
+    static inline void Name##PushBack(Name *q, Type item)                      \
+    {                                                                          \
+        if (q->size == q->capacity)                                            \
+            Name##Grow(q);                                                     \
+        q->data[(q->head + q->size) & (q->capacity - 1)] = item;               \
+        q->size += 1;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##Front(Name *q)                                   \
+    {                                                                          \
+        assert(q->size > 0);                                                   \
+        return &q->data[q->head];                                              \
+    }                                                                          \
+                                                                               \
+    static inline Type Name##PopFront(Name *q)                                 \
+    {                                                                          \
+        assert(q->size > 0);                                                   \
+        Type item = q->data[q->head];                                          \
+        q->head = (q->head + 1) & (q->capacity - 1);                           \
+        q->size -= 1;                                                          \
+        return item;                                                           \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##Back(Name *q)                                    \
+    {                                                                          \
+        assert(q->size > 0);                                                   \
+        return &q->data[(q->head + q->size - 1) & (q->capacity - 1)];          \
+    }                                                                          \
+                                                                               \
+    static inline Type Name##PopBack(Name *q)                                  \
+    {                                                                          \
+        assert(q->size > 0);                                                   \
+        q->size -= 1;                                                          \
+        return q->data[(q->head + q->size) & (q->capacity - 1)];               \
+    }
+
+#endif
@@ -0,0 +1,649 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <stdlib.h>     /* for malloc() and exit() */
+#include <string.h>     /* for memset() */
+#include <unistd.h>     /* for close() */
+#include <fcntl.h>      /* for fcntl() */
+#include <poll.h>       /* for poll() */
+
+#include "Address.h"
+#include "IO.h"
+#include "Book.h"
+#include "Task.h"
+#include "Codec.h"
+#include "DList.h"
+#include "Queue.h"
+#include "HashSet.h"
+#include "RowRange.h"
+#include "Clock.h"
+
+// Relay between the library server and a group of workers. Downstream it speaks the
+// worker protocol, so the workers run unchanged; upstream it takes tasks in batches
+// ("TASKS") and forwards the results in batches ("RESULTS"). Only one request to the
+// server is outstanding at a time: the messages of the workers which arrive meanwhile
+// make up the next batch, so the batches grow with the load by themselves. Nobody
+// waits for the results, so they are held until a datagram is full or for a while.
+
+#define MSGMAX 255               /* Longest message string */
+#define HEARTBEAT_PERIOD_MS 1000 /* Silence after which the server is sent a heartbeat */
+#define RETRANSMIT_FIRST_MS 50   /* First retransmission delay, doubled after each retry */
+#define RETRANSMIT_LAST_MS 1000  /* Longest retransmission delay */
+#define SHUTDOWN_DELAY_MS 5000   /* Time the relay keeps telling workers to stop */
+#define RESULT_TEXT_MAX 48       /* Longest " ID:M:N:K" of a result batch */
+#define RESULT_BATCH 8           /* Results sent at once, however long they are held */
+#define RESULT_HOLD_MS 200       /* Longest time a result is held to fill a batch */
+#define OUT_QUEUE_CAPACITY 1024  /* Datagrams each socket holds while its buffer is full */
+#define FLUSH_PERIOD_MS 1        /* Pause while datagrams are still queued */
+#define PREFETCH_DIVISOR 4       /* One task is fetched ahead for this many workers, well within the lease */
+#define WORKER_TIMEOUT_MS 3000   /* Worker silence after which it is dropped, as the server does */
+#define WORKER_SCAN_PERIOD_MS 1000 /* How often the relay looks for silent workers */
+#define LEASE_TIMEOUT_MS 5000    /* Lease of a task at the server, LEASE_TIMEOUT of Library.h */
+#define WORKER_SERVICE_MS 3000   /* Longest time a worker takes for a task */
+#define NETWORK_SLACK_MS 500     /* Allowance for the trips and retransmissions of a task and its result */
+/* A pooled task still leaves a worker the time to finish it and its result the time to reach the server */
+#define POOL_TIMEOUT_MS (LEASE_TIMEOUT_MS - WORKER_SERVICE_MS - RESULT_HOLD_MS - NETWORK_SLACK_MS)
+#define ROW_LIST_MAX (MSGMAX - 6 - 2 * CODEC_INT_MAX - 2) /* Longest row list of "TASKS:SEQ COUNT ROWS" */
+
+// Task taken from the server and not given to a worker yet. The lease of the server
+// runs from the time it handed the task out, heartbeats do not extend it.
+typedef struct PooledTask
+{
+    Task task;
+    long takenAt; // ns
+} PooledTask;
+
+DEFINE_QUEUE(TaskPool, PooledTask)
+DEFINE_QUEUE(ResultQueue, Book) // Results not forwarded to the server yet
+
+// Worker served by the relay
+typedef struct RelayWorker
+{
+    Address addr;
+    char rowList[MSGMAX + 1];      // rows as advertised, "" for the whole library
+    RowRange rows[MAX_ROW_RANGES];
+    int rowRangeCount;
+    int seq;                       // sequence number of the request waiting for a task, -1 if none
+    int lastRequest;               // sequence number of the last request, 0 if none
+    char lastReply[MSGMAX + 1];    // reply to it, "" while it waits for a task
+    int waiting;                   // the worker is in the waiting list
+    DLink waitLink;                // link in the waiting list
+    int busy;                      // the worker has a task and has not sent its result yet
+    PooledTask task;               // that task, returned to the pool if the worker goes away
+    long lastSeen;                 // time of the last message, ns
+} RelayWorker;
+
+// Workers are allocated separately: the waiting list points into them
+typedef RelayWorker *WorkerRef;
+#define WorkerHash(ref) AddressHash(&(*(ref))->addr)
+#define WorkerEqual(ref1, ref2) AddressEqual(&(*(ref1))->addr, &(*(ref2))->addr)
+
+DEFINE_HASHSET(WorkerSet, WorkerRef, WorkerHash, WorkerEqual)
+
+// Request sent to the server and not answered yet
+typedef struct UpstreamRequest
+{
+    int seq; // 0 if there is no request
+    char msg[MSGMAX + 1];
+    char rowList[MSGMAX + 1]; // rows of a task request
+    int isTasks;              // a task request, otherwise a result batch
+    long sentAt;              // ns, first sent
+    long retryAt;             // ns
+    int delayMs;              // delay before the next retry
+} UpstreamRequest;
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// Finds the worker, creates it if create is set
+RelayWorker *FindWorker(const Address *addr, int create);
+// Removes the worker, its unfinished task goes back to the pool
+void RemoveWorker(RelayWorker *worker);
+// Removes the workers which have been silent for WORKER_TIMEOUT_MS
+void ExpireWorkers();
+// Handles a message of a worker
+void HandleWorkerMessage(char *msg, const Address *workerAddr);
+// Answers the waiting request of the worker
+void ReplyToWorker(RelayWorker *worker, const char *body);
+// Drops the pooled tasks taken too long ago, and if checkRows is set those
+// in rows no worker holds; the server hands them out again once their leases expire
+void PrunePool(int checkRows);
+// Gives the pooled tasks to the waiting workers holding their rows
+void ServeWaiting();
+// Sends the next batch to the server if no request is outstanding
+void SendUpstream();
+// Handles a reply of the server
+void HandleServerReply(char *msg);
+
+int downSock; /* Socket of the workers */
+int upSock;   /* Socket of the server */
+OutQueue downQueue; /* Replies waiting for room in the socket of the workers */
+OutQueue upQueue;   /* Requests waiting for room in the socket of the server */
+Address serverAddr;
+WorkerSet workers;
+DList waiting; /* Workers waiting for a task, in arrival order */
+TaskPool pool;
+ResultQueue results;
+UpstreamRequest upstream;
+int nextSeq = 1;     /* Sequence number of the next request to the server */
+long lastUpstreamAt; /* Time of the last message to the server, ns */
+long lastWorkerScan; /* Time ExpireWorkers last ran, ns */
+long resultsSince;   /* Time the oldest queued result arrived, ns */
+int finished;        /* The server has no tasks left */
+
+// Counters reported with STATS
+long workerRequests;  /* task requests and results of the workers */
+long serverRequests;  /* batches sent to the server, retransmissions excluded */
+long retransmissions; /* batches sent again */
+long tasksIn;         /* tasks taken from the server */
+long tasksDropped;    /* tasks dropped from the pool */
+long resultsOut;      /* results forwarded to the server */
+
+int main(int argc, char *argv[])
+{
+    Address localAddr;       /* Address the workers send to */
+    Address fromAddr;        /* Source address of a message */
+    char buffer[MSGMAX + 1]; /* Buffer for receiving messages */
+    int msgLen;              /* Length of received message */
+
+    if (argc < 3 || AddressFromArgs(argv + 2, argc - 2, &serverAddr) != argc - 2) /* Test for correct number of arguments */
+    {
+        fprintf(stderr, "Usage: %s <RELAY PORT | unix:<PATH>> <Server IP> <Server Port>\n", argv[0]);
+        fprintf(stderr, "       %s <RELAY PORT | unix:<PATH>> unix:<Server Socket Path>\n", argv[0]);
+        fprintf(stderr, "  Workers are started with the relay address instead of the server one\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!AddressParseLocal(argv[1], &localAddr) || localAddr.sa.sa_family == AF_SHM)
+    {
+        fprintf(stderr, "Invalid relay address '%s'\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    downSock = CreateServerSocket(&localAddr);
+    upSock = CreateClientSocket(&serverAddr);
+
+    // Both sockets are drained after poll(), so that a batch takes all the waiting messages
+    if (fcntl(downSock, F_SETFL, O_NONBLOCK) < 0 || fcntl(upSock, F_SETFL, O_NONBLOCK) < 0)
+        DieWithError("Unable to put the sockets into nonblocking mode");
+
+    OutQueueInit(&downQueue, downSock, OUT_QUEUE_CAPACITY);
+    OutQueueInit(&upQueue, upSock, OUT_QUEUE_CAPACITY);
+    WorkerSetInit(&workers);
+    DListInit(&waiting);
+    TaskPoolInit(&pool);
+    ResultQueueInit(&results);
+    lastUpstreamAt = ClockNowNs();
+
+    struct pollfd pfds[2];
+    pfds[0].fd = downSock;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = upSock;
+    pfds[1].events = POLLIN;
+
+    long finishedAt = -1;
+    for (;;)
+    {
+        long now = ClockNowNs();
+        if (finished && finishedAt < 0)
+            finishedAt = now;
+        if (finishedAt >= 0 && ResultQueueEmpty(&results) && upstream.seq == 0 &&
+            now - finishedAt > SHUTDOWN_DELAY_MS * NS_PER_MS)
+            break;
+
+        if (upstream.seq != 0 && now >= upstream.retryAt)
+        {
+            OutQueueSend(&upQueue, upstream.msg, strlen(upstream.msg), &serverAddr);
+            lastUpstreamAt = now;
+            retransmissions += 1;
+            upstream.delayMs = upstream.delayMs * 2 < RETRANSMIT_LAST_MS ? upstream.delayMs * 2 : RETRANSMIT_LAST_MS;
+            upstream.retryAt = now + upstream.delayMs * NS_PER_MS;
+        }
+
+        // The leases of the relay stay alive while its workers are busy
+        if (now - lastUpstreamAt >= HEARTBEAT_PERIOD_MS * NS_PER_MS)
+        {
+            OutQueueSend(&upQueue, "HEARTBEAT", strlen("HEARTBEAT"), &serverAddr);
+            lastUpstreamAt = now;
+        }
+
+        // Workers which went away without DISCONNECT
+        if (now - lastWorkerScan >= WORKER_SCAN_PERIOD_MS * NS_PER_MS)
+            ExpireWorkers();
+
+        long wakeAt = lastUpstreamAt + HEARTBEAT_PERIOD_MS * NS_PER_MS;
+        if (upstream.seq != 0 && upstream.retryAt < wakeAt)
+            wakeAt = upstream.retryAt;
+        if (upstream.seq == 0 && !ResultQueueEmpty(&results) && resultsSince + RESULT_HOLD_MS * NS_PER_MS < wakeAt)
+            wakeAt = resultsSince + RESULT_HOLD_MS * NS_PER_MS;
+        int timeoutMs = (wakeAt - now + NS_PER_MS - 1) / NS_PER_MS;
+
+        // A full Unix-domain peer does not show in poll(), so queued datagrams are retried soon
+        if (OutQueueFlush(&downQueue) + OutQueueFlush(&upQueue) > 0 && timeoutMs > FLUSH_PERIOD_MS)
+            timeoutMs = FLUSH_PERIOD_MS;
+
+        if (poll(pfds, 2, timeoutMs > 0 ? timeoutMs : 0) <= 0)
+        {
+            SendUpstream();
+            continue;
+        }
+
+        msgLen = MSGMAX;
+        while (RecvFromUnblocked(upSock, buffer, &msgLen, &fromAddr))
+        {
+            buffer[msgLen] = '\0';
+            if (AddressFromServer(&serverAddr, &fromAddr))
+                HandleServerReply(buffer);
+            msgLen = MSGMAX;
+        }
+
+        msgLen = MSGMAX;
+        while (RecvFromUnblocked(downSock, buffer, &msgLen, &fromAddr))
+        {
+            buffer[msgLen] = '\0';
+            HandleWorkerMessage(buffer, &fromAddr);
+            msgLen = MSGMAX;
+        }
+
+        PrunePool(0);
+        ServeWaiting();
+        SendUpstream();
+    }
+
+    printf("The relay is shutting down.\n");
+
+    for (int i = workers.size - 1; i >= 0; --i)
+    {
+        RemoveWorker(workers.items[i]);
+    }
+    WorkerSetFree(&workers);
+    TaskPoolFree(&pool);
+    ResultQueueFree(&results);
+    OutQueueFree(&downQueue);
+    OutQueueFree(&upQueue);
+
+    if (localAddr.sa.sa_family == AF_UNIX)
+        unlink(localAddr.un.sun_path);
+    close(downSock);
+    close(upSock);
+    exit(EXIT_SUCCESS);
+}
+
+RelayWorker *FindWorker(const Address *addr, int create)
+{
+    RelayWorker key;
+    key.addr = *addr;
+    WorkerRef keyRef = &key;
+
+    WorkerRef *ref = WorkerSetFind(&workers, &keyRef);
+    if (ref)
+        return *ref;
+    if (!create)
+        return NULL;
+
+    RelayWorker *worker = malloc(sizeof(*worker));
+    memset(worker, 0, sizeof(*worker));
+    worker->addr = *addr;
+    worker->seq = -1;
+    worker->lastSeen = ClockNowNs();
+    WorkerSetInsert(&workers, worker, NULL);
+    return worker;
+}
+
+void RemoveWorker(RelayWorker *worker)
+{
+    if (worker->waiting)
+        DListRemove(&waiting, &worker->waitLink);
+    // Another worker may still finish it within the lease, otherwise PrunePool drops it
+    if (worker->busy)
+        TaskPoolPushBack(&pool, worker->task);
+
+    WorkerRef ref = worker;
+    WorkerSetRemove(&workers, &ref);
+    free(worker);
+}
+
+void HandleWorkerMessage(char *msg, const Address *workerAddr)
+{
+    char reply[MSGMAX + 1];
+    RowRange rows[MAX_ROW_RANGES];
+    int rowRangeCount = -1; // rows advertised with the task request, -1 if none
+    char rowList[ROW_LIST_MAX + 1];
+    int seq = -1;           // sequence number of the request, -1 if none
+    Book book;
+    int isResult = 0;
+
+    if (strcmp(msg, "HEARTBEAT") == 0)
+    {
+        // The relay sends its own heartbeats to the server
+        RelayWorker *worker = FindWorker(workerAddr, 0);
+        if (worker)
+            worker->lastSeen = ClockNowNs();
+        return;
+    }
+
+    if (strcmp(msg, "DISCONNECT") == 0)
+    {
+        RelayWorker *worker = FindWorker(workerAddr, 0);
+        if (worker)
+        {
+            RemoveWorker(worker);
+            PrunePool(1);
+        }
+        return;
+    }
+
+    if (strcmp(msg, "STATS") == 0)
+    {
+        sprintf(reply, "workers=%d waiting=%d pooled_tasks=%d queued_results=%d worker_requests=%ld server_requests=%ld retransmissions=%ld tasks_in=%ld tasks_dropped=%ld results_out=%ld",
+                workers.size, DListSize(&waiting), TaskPoolSize(&pool), ResultQueueSize(&results),
+                workerRequests, serverRequests, retransmissions, tasksIn, tasksDropped, resultsOut);
+        OutQueueSend(&downQueue, reply, strlen(reply), workerAddr);
+        OutQueueFormat(&downQueue, "down", reply);
+        OutQueueSend(&downQueue, reply, strlen(reply), workerAddr);
+        OutQueueFormat(&upQueue, "up", reply);
+        OutQueueSend(&downQueue, reply, strlen(reply), workerAddr);
+        OutQueueSend(&downQueue, "END_STATS", strlen("END_STATS"), workerAddr);
+        return;
+    }
+
+    if (strncmp(msg, "GIVE_ME_TASK", 12) == 0 && (msg[12] == '\0' || msg[12] == ' ' || msg[12] == ':'))
+    {
+        // GIVE_ME_TASK[:SEQ][ ROWS], as the server takes it
+        const char *rest = msg + 12;
+        if (*rest == ':' && !(rest = CodecParseInt(rest + 1, &seq)))
+            return;
+        if (*rest == ' ' && (rowRangeCount = RowRangesParse(rest + 1, rows, MAX_ROW_RANGES)) < 0)
+            return;
+        // Written again as "FIRST-LAST" ranges, which must still fit into a TASKS request
+        if (rowRangeCount >= 0 && RowRangesFormat(rowList, sizeof(rowList), rows, rowRangeCount) < 0)
+            return;
+    }
+    else
+    {
+        int values[5];
+        int fields = CodecParseFields(msg, ':', values, 5, NULL);
+        if (fields < 4)
+            return; // observers and anything else are for the server
+        book.id = values[0];
+        book.pos.m = values[1];
+        book.pos.n = values[2];
+        book.pos.k = values[3];
+        seq = fields == 5 ? values[4] : -1;
+        isResult = 1;
+
+        // Acknowledge the result at once, as the server does
+        if (seq >= 0)
+        {
+            CodecFormatInt(stpcpy(reply, "ACK "), seq);
+            OutQueueSend(&downQueue, reply, strlen(reply), workerAddr);
+        }
+    }
+
+    RelayWorker *worker = FindWorker(workerAddr, 1);
+    worker->lastSeen = ClockNowNs();
+
+    if (seq >= 0 && seq <= worker->lastRequest)
+    {
+        // A retransmission: answered again if the reply exists, ignored while the task is awaited
+        if (seq == worker->lastRequest && worker->lastReply[0] != '\0')
+            OutQueueSend(&downQueue, worker->lastReply, strlen(worker->lastReply), workerAddr);
+        return;
+    }
+
+    workerRequests += 1;
+    worker->busy = 0;
+    if (isResult)
+    {
+        if (ResultQueueEmpty(&results))
+            resultsSince = ClockNowNs();
+        ResultQueuePushBack(&results, book);
+    }
+
+    if (rowRangeCount >= 0)
+    {
+        memcpy(worker->rows, rows, rowRangeCount * sizeof(*rows));
+        worker->rowRangeCount = rowRangeCount;
+        strcpy(worker->rowList, rowList);
+    }
+    if (seq >= 0)
+    {
+        worker->lastRequest = seq;
+        worker->lastReply[0] = '\0';
+    }
+    worker->seq = seq;
+
+    // A result is followed by the next task, as with the server
+    if (finished)
+    {
+        ReplyToWorker(worker, "NO_MORE_TASKS");
+    }
+    else if (!worker->waiting)
+    {
+        worker->waiting = 1;
+        DListPushBack(&waiting, &worker->waitLink);
+    }
+}
+
+void ReplyToWorker(RelayWorker *worker, const char *body)
+{
+    char reply[MSGMAX + 1];
+
+    if (worker->seq >= 0)
+    {
+        char *end = stpcpy(reply, body);
+        *end++ = ':';
+        CodecFormatInt(end, worker->seq);
+        strcpy(worker->lastReply, reply);
+    }
+    else
+    {
+        strcpy(reply, body);
+    }
+    OutQueueSend(&downQueue, reply, strlen(reply), &worker->addr);
+
+    if (worker->waiting)
+    {
+        DListRemove(&waiting, &worker->waitLink);
+        worker->waiting = 0;
+    }
+}
+
+void ExpireWorkers()
+{
+    long now = ClockNowNs();
+    int removed = 0;
+
+    lastWorkerScan = now;
+    for (int i = workers.size - 1; i >= 0; --i)
+    {
+        if (now - workers.items[i]->lastSeen > WORKER_TIMEOUT_MS * NS_PER_MS)
+        {
+            RemoveWorker(workers.items[i]);
+            removed = 1;
+        }
+    }
+    if (removed)
+        PrunePool(1);
+}
+
+void PrunePool(int checkRows)
+{
+    long now = ClockNowNs();
+    int size = TaskPoolSize(&pool);
+
+    for (int i = 0; i < size; ++i)
+    {
+        PooledTask pooled = TaskPoolPopFront(&pool);
+        int held = !checkRows;
+        for (int w = 0; !held && w < workers.size; ++w)
+        {
+            held = RowRangesContain(workers.items[w]->rows, workers.items[w]->rowRangeCount, pooled.task.m);
+        }
+        if (held && now - pooled.takenAt < POOL_TIMEOUT_MS * NS_PER_MS)
+            TaskPoolPushBack(&pool, pooled);
+        else
+            tasksDropped += 1;
+    }
+}
+
+void ServeWaiting()
+{
+    char taskBuffer[MSGMAX + 1];
+    DLink *link = waiting.head.next;
+
+    while (link != &waiting.head && !TaskPoolEmpty(&pool))
+    {
+        RelayWorker *worker = DLIST_ENTRY(link, RelayWorker, waitLink);
+        link = link->next;
+
+        // Take the first pooled task in the rows of the worker, the pool stays in order
+        int size = TaskPoolSize(&pool);
+        for (int i = 0; i < size; ++i)
+        {
+            PooledTask pooled = TaskPoolPopFront(&pool);
+            if (worker->waiting && RowRangesContain(worker->rows, worker->rowRangeCount, pooled.task.m))
+            {
+                TaskCreateMessage(taskBuffer, &pooled.task);
+                ReplyToWorker(worker, taskBuffer);
+                worker->busy = 1;
+                worker->task = pooled;
+            }
+            else
+            {
+                TaskPoolPushBack(&pool, pooled);
+            }
+        }
+    }
+}
+
+// Sends the request just written to the buffer, the first retry comes soon
+static void StartUpstream()
+{
+    upstream.delayMs = RETRANSMIT_FIRST_MS;
+    upstream.sentAt = ClockNowNs();
+    upstream.retryAt = upstream.sentAt + upstream.delayMs * NS_PER_MS;
+    lastUpstreamAt = ClockNowNs();
+    serverRequests += 1;
+    OutQueueSend(&upQueue, upstream.msg, strlen(upstream.msg), &serverAddr);
+}
+
+void SendUpstream()
+{
+    if (upstream.seq != 0)
+        return;
+
+    // Results are sent once a batch is full, after the hold time or when the server is done
+    int sendResults = ResultQueueSize(&results) >= RESULT_BATCH ||
+                      (!ResultQueueEmpty(&results) && (finished || ClockNowNs() - resultsSince >= RESULT_HOLD_MS * NS_PER_MS));
+
+    // Results and task requests take turns, so that neither waits behind the other
+    int sendTasks = !DListEmpty(&waiting) && !finished && (!sendResults || !upstream.isTasks);
+    if (!sendTasks && !sendResults)
+        return;
+
+    upstream.seq = nextSeq++;
+    upstream.isTasks = sendTasks;
+
+    if (sendTasks)
+    {
+        // Ask for a task for each waiting worker holding the same rows as the first one,
+        // and for some more, so that the next requests of these workers are served at once
+        RelayWorker *first = DLIST_ENTRY(DListFront(&waiting), RelayWorker, waitLink);
+        int count = 0;
+        DLIST_FOREACH(link, &waiting)
+        {
+            RelayWorker *worker = DLIST_ENTRY(link, RelayWorker, waitLink);
+            count += strcmp(worker->rowList, first->rowList) == 0;
+        }
+        int holders = 0;
+        for (int i = 0; i < workers.size; ++i)
+        {
+            holders += strcmp(workers.items[i]->rowList, first->rowList) == 0;
+        }
+        count += holders / PREFETCH_DIVISOR;
+
+        strcpy(upstream.rowList, first->rowList);
+        int len = snprintf(upstream.msg, sizeof(upstream.msg), "TASKS:%d %d%s%s", upstream.seq, count,
+                           first->rowList[0] != '\0' ? " " : "", first->rowList);
+        if (len < 0 || len > MSGMAX)
+        {
+            fprintf(stderr, "The TASKS request does not fit into a message\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        // As many results as fit into the datagram
+        int len = CodecFormatInt(stpcpy(upstream.msg, "RESULTS:"), upstream.seq) - upstream.msg;
+        while (!ResultQueueEmpty(&results) && len + RESULT_TEXT_MAX < MSGMAX)
+        {
+            Book book = ResultQueuePopFront(&results);
+            int fields[4] = {book.id, book.pos.m, book.pos.n, book.pos.k};
+            upstream.msg[len] = ' ';
+            len = CodecFormatFields(upstream.msg + len + 1, ':', fields, 4) - upstream.msg;
+            resultsOut += 1;
+        }
+        resultsSince = ClockNowNs();
+    }
+
+    StartUpstream();
+}
+
+void HandleServerReply(char *msg)
+{
+    int seq;
+    const char *rest;
+
+    if (strncmp(msg, "ACK ", 4) == 0 && CodecParseInt(msg + 4, &seq))
+    {
+        // The result batch is stored
+        if (seq == upstream.seq && !upstream.isTasks)
+            upstream.seq = 0;
+        return;
+    }
+
+    if (strncmp(msg, "TASKS:", 6) == 0 && (rest = CodecParseInt(msg + 6, &seq)))
+    {
+        if (seq != upstream.seq)
+            return; // the reply to a retransmission which was already answered
+
+        int fields[3];
+        for (const char *str = rest; *str == ' ' && CodecParseFields(str + 1, ':', fields, 3, &str) == 3;)
+        {
+            // The server leased the tasks no earlier than the request was first sent
+            PooledTask pooled = {{fields[0], fields[1], fields[2]}, upstream.sentAt};
+            TaskPoolPushBack(&pool, pooled);
+            tasksIn += 1;
+        }
+        upstream.seq = 0;
+        return;
+    }
+
+    // PENDING:SEQ or NO_MORE_TASKS:SEQ
+    char *colon = strrchr(msg, ':');
+    if (!colon || !CodecParseInt(colon + 1, &seq) || seq != upstream.seq || !upstream.isTasks)
+        return;
+    *colon = '\0';
+    upstream.seq = 0;
+
+    if (strcmp(msg, "NO_MORE_TASKS") == 0)
+    {
+        finished = 1;
+        while (!DListEmpty(&waiting))
+        {
+            ReplyToWorker(DLIST_ENTRY(DListFront(&waiting), RelayWorker, waitLink), "NO_MORE_TASKS");
+        }
+    }
+    else if (strcmp(msg, "PENDING") == 0)
+    {
+        // The workers the request was made for retry later, as they do with the server
+        DLink *link = waiting.head.next;
+        while (link != &waiting.head)
+        {
+            RelayWorker *worker = DLIST_ENTRY(link, RelayWorker, waitLink);
+            link = link->next;
+            if (strcmp(worker->rowList, upstream.rowList) == 0)
+                ReplyToWorker(worker, "PENDING");
+        }
+    }
+}
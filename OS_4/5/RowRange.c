@@ -0,0 +1,65 @@
+#include "RowRange.h"
+#include "Codec.h"
+#include <string.h> /* for memcpy() */
+
+int RowRangesParse(const char *str, RowRange *ranges, int maxCount)
+{
+    int count = 0;
+    for (;;)
+    {
+        RowRange range;
+        str = CodecParseInt(str, &range.first);
+        if (!str)
+            return -1;
+        range.last = range.first;
+        if (*str == '-' && !(str = CodecParseInt(str + 1, &range.last)))
+            return -1;
+        if (range.first < 0 || range.last < range.first || count == maxCount)
+            return -1;
+        ranges[count++] = range;
+
+        if (*str == '\0')
+            return count;
+        if (*str != ',')
+            return -1;
+        ++str;
+    }
+}
+
+int RowRangesFormat(char *str, int size, const RowRange *ranges, int count)
+{
+    int len = 0;
+    *str = '\0';
+    for (int i = 0; i < count; ++i)
+    {
+        // ",FIRST-LAST"
+        char range[2 * CODEC_INT_MAX + 3];
+        char *end = range;
+        if (i)
+            *end++ = ',';
+        end = CodecFormatInt(end, ranges[i].first);
+        *end++ = '-';
+        end = CodecFormatInt(end, ranges[i].last);
+
+        if (len + (end - range) >= size)
+        {
+            *str = '\0';
+            return -1;
+        }
+        memcpy(str + len, range, end - range + 1);
+        len += end - range;
+    }
+    return len;
+}
+
+int RowRangesContain(const RowRange *ranges, int count, int m)
+{
+    if (count == 0)
+        return 1;
+    for (int i = 0; i < count; ++i)
+    {
+        if (ranges[i].first <= m && m <= ranges[i].last)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef ROWRANGE_H
+#define ROWRANGE_H
+
+// Rows of the library held by a worker, advertised as "FIRST-LAST,FIRST-LAST,..."
+// (a single row may be written as "ROW"). No ranges means the whole library.
+
+#define MAX_ROW_RANGES 16
+
+typedef struct RowRange
+{
+    int first, last; // inclusive
+} RowRange;
+
+// Parses the list, returns the number of ranges or -1 if it is invalid
+int RowRangesParse(const char *str, RowRange *ranges, int maxCount);
+
+// Writes the list to str, which holds size bytes; returns its length,
+// or -1 if it does not fit (str is then left empty)
+int RowRangesFormat(char *str, int size, const RowRange *ranges, int count);
+
+// Checks if the row is held, any row is when count is 0
+int RowRangesContain(const RowRange *ranges, int count, int m);
+
+#endif
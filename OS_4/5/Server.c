@@ -1,376 +1,339 @@
 #define _DEFAULT_SOURCE
-#include <stdio.h>  /* for printf() and fprintf() */
+#include <stdio.h>  /* for fprintf() */
 #include <stdlib.h> /* for atoi() and exit() */
 #include <string.h> /* for memset() */
-#include <unistd.h> /* for close() */
-#include <time.h>   /* for time() */
+#include <unistd.h> /* for close(), usleep() and getopt() */
 #include <signal.h>
 
-#include "List.h"
-#include "Book.h"
-#include "Task.h"
+#include "Library.h"
 #include "IO.h"
+#include "Shm.h"
 
-#define MSGMAX 255 /* Longest message string */
-#define ADDRLEN 24
-
-typedef struct List Catalog;   // Ordered list of the books
-typedef struct List TaskQueue; // Queue of the tasks
-
-typedef struct Observer
-{
-    struct sockaddr_in addr;
-} Observer;
-
-typedef struct PendingTask
-{
-    Task task;
-    time_t time;
-} PendingTask;
-
-typedef struct List PendingTaskQueue; // Queue of the tasks
-
-// Structure to store all system variables
-typedef struct Library
-{
-    Catalog *catalog;    // Ordered list of books
-    int catalogFullSize; // M * N * K
-    TaskQueue *taskQueue;
-    PendingTaskQueue *pendingTaskQueue;
-    int sock;
-    List *observers;
-    int ready;
-} Library;
+#define MAX_ENDPOINTS 4          /* Local addresses the server listens on */
+#define OUT_QUEUE_CAPACITY 1024  /* Replies each socket holds while its buffer is full */
+#define FLUSH_PERIOD_US 1000     /* Idle pause while replies are still queued */
+#define SHUTDOWN_PAUSE_US 100000 /* Pause of the shutdown wait while nothing is queued */
 
 Library library; /* GLOBAL for signal handler */
 
-/* Initializes the library*/
-void Initialize(Library *library, int M, int N, int K);
-
-void UpdateQueues(Library *library);
+// The server listens on a UDP port, a Unix-domain socket and a shared-memory
+// segment at the same time, a reply leaves the way its request came in
+Address endpoints[MAX_ENDPOINTS]; /* GLOBAL for signal handler */
+int socks[MAX_ENDPOINTS];         /* GLOBAL for signal handler, -1 for shared memory */
+OutQueue outQueues[MAX_ENDPOINTS]; /* GLOBAL for signal handler, replies waiting for room in the sockets */
 
-int ObserverCompare(const void *, const void *);
-
-void NotifyObservers(Library *library, const char *msg);
-
-int TaskCompare(const void *, const void *);
-
-/* Parse message from client*/
-int ParseMessage(char *msg, Book *book);
+// What the kernel reports about the datagrams received on a socket
+typedef struct SocketStats
+{
+    int rcvBufSize, sndBufSize; // buffer sizes given by the kernel
+    long received;              // datagrams received
+    unsigned kernelDrops;       // datagrams dropped by the kernel, the receive queue being full
+    Histogram queueDelay;       // time from the arrival of a datagram to its reception, ns
+} SocketStats;
 
-/* Print Catalog */
-void PrintCatalog(Library *library);
+SocketStats socketStats[MAX_ENDPOINTS]; /* GLOBAL for signal handler */
+int endpointCount;
+ShmServer shm;                    /* GLOBAL for signal handler */
+int shmEnabled;
 
 void DieWithError(char *errorMessage); /* Error handling function */
 void UseIdleTime();                    /* Function to use idle time */
 void SIGIOHandler(int signalType);     /* Function to handle SIGIO */
+void ServerSend(const char *msg, int msgLen, const Address *addr); /* Sends replies of the library */
+void ServerSendStats(const Address *addr); /* Sends the counters of the sockets */
+// Sends the queued replies which fit, returns the number still queued
+int FlushOutQueues();
+// Parses the comma-separated local addresses, returns 0 if one is invalid
+int ParseEndpoints(char *list);
 
 int main(int argc, char *argv[])
 {
+    const char *program = argv[0];
+    const char *serveTime = "5";
+    int opt, badOption = 0;
+
+    /* The only option: -s <Serve Time>, it may come anywhere */
+    while ((opt = getopt(argc, argv, "s:")) != -1)
+    {
+        if (opt == 's')
+            serveTime = optarg;
+        else
+            badOption = 1;
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     /* Test for correct number of parameters */
-    if (argc != 5)
+    if (badOption || argc < 5 || argc > 9)
     {
-        fprintf(stderr, "Usage:  %s <SERVER PORT> <M> <N> <K>\n", argv[0]);
+        fprintf(stderr, "Usage:  %s [-s <Serve Time>] <SERVER PORT>[,unix:<PATH>][,shm:<NAME>] <M> <N> <K> [<Log Level> [<Rows> [<Receive Buffer> [<Send Buffer>]]]]\n", program);
+        fprintf(stderr, "  The server listens on each of the comma-separated local addresses,\n");
+        fprintf(stderr, "  a UDP port, a Unix-domain socket or a shared-memory segment for local workers\n");
+        fprintf(stderr, "  Log Level: error | warn | info (default) | debug\n");
+        fprintf(stderr, "  Rows: FIRST-LAST, serve only these rows as a partition of a Coordinator,\n");
+        fprintf(stderr, "  which must fetch the catalog before the server shuts down, or all\n");
+        fprintf(stderr, "  Receive Buffer, Send Buffer: socket buffer sizes in bytes, 0 for the system default\n");
+        fprintf(stderr, "  Serve Time: seconds the recovered catalog is kept for WHERE and WHAT queries\n");
+        fprintf(stderr, "  before the server shuts down, 5 by default, or forever, e.g. -s forever\n");
         exit(EXIT_FAILURE);
     }
 
-    unsigned short libServPort = atoi(argv[1]); /* First arg:  local port */
+    /* First arg:  local addresses */
+    if (!ParseEndpoints(argv[1]))
+    {
+        fprintf(stderr, "Invalid server address '%s'\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
 
     const int M = atoi(argv[2]);
     const int N = atoi(argv[3]);
     const int K = atoi(argv[4]);
 
-    Initialize(&library, M, N, K);
-
-    library.sock = CreateUDPServerWithSIGIO(libServPort, SIGIOHandler);
-
-    /* Go off and do real work; message receiving happens in the background */
+    int level = argc > 5 ? LogLevelParse(argv[5]) : LOG_INFO;
+    if (level < 0)
+    {
+        fprintf(stderr, "Unknown log level '%s'\n", argv[5]);
+        exit(EXIT_FAILURE);
+    }
 
-    while (!library.ready)
+    RowRange rows = {0, M - 1};
+    const int partition = argc > 6 && strcmp(argv[6], "all") != 0;
+    if (partition && (RowRangesParse(argv[6], &rows, 1) != 1 || rows.last >= M))
     {
-        UseIdleTime();
+        fprintf(stderr, "Invalid rows '%s'\n", argv[6]);
+        exit(EXIT_FAILURE);
     }
 
-    // wait a bit so that the server has time to respond to waiting clients
-    sleep(5);
+    const int rcvBufSize = argc > 7 ? atoi(argv[7]) : 0;
+    const int sndBufSize = argc > 8 ? atoi(argv[8]) : 0;
 
-    close(library.sock);
+    const int forever = strcmp(serveTime, "forever") == 0;
+    const int serveSeconds = forever ? 0 : atoi(serveTime);
+    if (serveSeconds < 0)
+    {
+        fprintf(stderr, "Invalid serve time '%s'\n", serveTime);
+        exit(EXIT_FAILURE);
+    }
 
-    printf("The server is shutting down.\n");
+    LogStart(level);
 
-    return EXIT_SUCCESS;
-}
+    InitializePartition(&library, rows.first, rows.last, N, K);
+    library.send = ServerSend;
+    library.sendTransportStats = ServerSendStats;
 
-void Initialize(Library *library, int M, int N, int K)
-{
-    library->catalog = ListCreate();
-    library->taskQueue = ListCreate();
-    library->pendingTaskQueue = ListCreate();
-    library->observers = ListCreate();
-    library->catalogFullSize = M * N * K;
-    library->ready = 0;
-
-    // Fill task queue
-    for (int m = 0; m < M; ++m)
+    for (int i = 0; i < endpointCount; ++i)
     {
-        for (int n = 0; n < N; ++n)
+        if (endpoints[i].sa.sa_family == AF_SHM)
         {
-            for (int k = 0; k < K; ++k)
-            {
-                Task *task = TaskCreate(m, n, k);
-                ListPushBack(library->taskQueue, task);
-            }
+            // Workers signal the server themselves when they queue a message
+            SetSIGIOHandler(SIGIOHandler);
+            ShmServerCreate(&shm, &endpoints[i]);
+            shmEnabled = 1;
+            socks[i] = -1;
+        }
+        else
+        {
+            socks[i] = CreateServerWithSIGIO(&endpoints[i], rcvBufSize, sndBufSize, SIGIOHandler);
+            OutQueueInit(&outQueues[i], socks[i], OUT_QUEUE_CAPACITY);
+            HistogramInit(&socketStats[i].queueDelay);
+            GetSocketBuffers(socks[i], &socketStats[i].rcvBufSize, &socketStats[i].sndBufSize);
         }
     }
-}
-
-int ObserverCompare(const void *a, const void *b)
-{
-    Observer *obs1 = (Observer *)a;
-    Observer *obs2 = (Observer *)b;
-    if (obs1->addr.sin_addr.s_addr == obs2->addr.sin_addr.s_addr && obs1->addr.sin_port == obs2->addr.sin_port)
-        return 0;
-    return -1;
-}
 
-int TaskCompare(const void *a, const void *b)
-{
-    PendingTask *t1 = (PendingTask *)a;
-    PendingTask *t2 = (PendingTask *)b;
-    if (t1->task.m == t2->task.m && t1->task.n == t2->task.n && t1->task.k == t2->task.k)
-        return 0;
-    return -1;
-}
+    /* Go off and do real work; message receiving happens in the background */
 
-void NotifyObservers(Library *library, const char *msg)
-{
-    Node *iter = library->observers->head;
-    while (iter)
+    // A partition keeps its catalog until the coordinator has it
+    while (!library.ready || (partition && !library.fetched))
     {
-        Observer *obs = (Observer *)iter->payload;
-        SendTo(library->sock, msg, strlen(msg), &obs->addr);
-        iter = iter->next;
+        UseIdleTime();
     }
-    printf("%s\n", msg);
-}
 
-int ParseMessage(char *msg, Book *book)
-{
-    if (sscanf(msg, "%d:%d:%d:%d", &book->id, &book->pos.m, &book->pos.n, &book->pos.k) != 4)
+    // wait a bit so that the server has time to respond to waiting clients
+    // and to send the queued replies, such as the catalog for the observers;
+    // meanwhile the catalog answers queries
+    if (forever)
+        LogWrite(LOG_INFO, "The catalog answers queries until the server is stopped.");
+    else
+        LogPrintf(LOG_INFO, "The catalog answers queries for %d s.", serveSeconds);
+    long shutdownAt = ClockNowNs() + serveSeconds * NS_PER_SEC;
+    while (forever || ClockNowNs() < shutdownAt)
     {
-        // Invalid message
-        return 0;
+        sigset_t sigblock;
+        sigfillset(&sigblock);
+        sigprocmask(SIG_BLOCK, &sigblock, NULL);
+        // Idle rate limits and silent sessions still expire, however long the catalog is served
+        UpdateQueues(&library);
+        int queued = FlushOutQueues();
+        sigprocmask(SIG_UNBLOCK, &sigblock, NULL);
+
+        usleep(queued > 0 ? FLUSH_PERIOD_US : SHUTDOWN_PAUSE_US);
     }
-    return 1;
-}
-
-void PrintCatalog(Library *library)
-{
-    char notifyBuffer[MSGMAX];
 
-    NotifyObservers(library, "The recovered catalog is:");
-    Node *node = library->catalog->head;
-    while (node)
+    for (int i = 0; i < endpointCount; ++i)
     {
-        Book *book = (Book *)node->payload;
-        sprintf(notifyBuffer, "%d - %d, %d, %d", book->id, book->pos.m, book->pos.n, book->pos.k);
-        NotifyObservers(library, notifyBuffer);
-        node = node->next;
+        if (socks[i] >= 0)
+        {
+            OutQueueFree(&outQueues[i]);
+            close(socks[i]);
+        }
+        if (endpoints[i].sa.sa_family == AF_UNIX)
+            unlink(endpoints[i].un.sun_path);
     }
+    if (shmEnabled)
+        ShmServerDestroy(&shm);
+
+    LogWrite(LOG_INFO, "The server is shutting down.");
+    LogStop();
+
+    return EXIT_SUCCESS;
 }
 
 void UseIdleTime()
 {
+    // Temporary block all signals
+    sigset_t sigblock;
+    sigfillset(&sigblock);
+    sigprocmask(SIG_BLOCK, &sigblock, NULL);
+
     // Moves uncompleted tasks from pending queue to task queue
     UpdateQueues(&library);
 
-    printf(".\n");
+    // Replies wait for room in the sockets
+    int queued = FlushOutQueues();
+
+    // Unblock signals
+    sigprocmask(SIG_UNBLOCK, &sigblock, NULL);
+
+    // A socket which drains does not always signal it, so queued replies are retried soon
+    if (queued > 0)
+    {
+        usleep(FLUSH_PERIOD_US);
+        return;
+    }
+
+    LogWrite(LOG_DEBUG, ".");
     sleep(5); /* 5 seconds of activity */
 }
 
 void SIGIOHandler(int signalType)
 {
-    struct sockaddr_in clientAddr; /* Address of datagram source */
-    int recvMsgSize;               /* Size of datagram */
-    char msgBuffer[MSGMAX];        /* Datagram buffer */
-    char addrBuffer[ADDRLEN];
-    char notifyBuffer[MSGMAX];
+    (void)signalType;
+    Address clientAddr;         /* Address of datagram source */
+    int recvMsgSize;            /* Size of datagram */
+    char msgBuffer[MSGMAX + 1]; /* Datagram buffer, with room for the terminating null */
+    RecvInfo info;              /* Kernel information about the datagram */
+    int received;
+
+    if (shmEnabled)
+        ShmServerAwake(&shm);
 
-    int sock = library.sock;
+    // The signal may tell that a socket has room again
+    FlushOutQueues();
 
     do
     {
-        /* As long as there is input... */
+        /* As long as there is input on any socket... */
+        received = 0;
 
-        // Receive message from client
-        recvMsgSize = MSGMAX;
-        if (RecvFromUnblocked(sock, msgBuffer, &recvMsgSize, &clientAddr))
+        for (int i = 0; i < endpointCount; ++i)
         {
-            /* null-terminate the received data */
-            msgBuffer[recvMsgSize] = '\0';
-
-            printf("Handling client %s:%d...\n", inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port));
-            sprintf(addrBuffer, "%s:%d", inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port));
-
-            if (strcmp(msgBuffer, "I_AM_OBSERVER") == 0)
+            // Receive message from client
+            recvMsgSize = MSGMAX;
+            if (socks[i] >= 0 ? RecvFromUnblockedInfo(socks[i], msgBuffer, &recvMsgSize, &clientAddr, &info)
+                              : ShmServerReceive(&shm, msgBuffer, &recvMsgSize, &clientAddr))
             {
-                // This is the first message from the observer client
-
-                Observer obs;
-                obs.addr = clientAddr;
-
-                if (!ListContains(library.observers, &obs, ObserverCompare))
+                if (socks[i] >= 0)
                 {
-                    // Add a new observer
-                    Observer *obsItem = malloc(sizeof(obsItem));
-                    obsItem->addr = clientAddr;
-                    ListPushBack(library.observers, obsItem);
-
-                    sprintf(notifyBuffer, "Client %s is registered as observer", addrBuffer);
-                    NotifyObservers(&library, notifyBuffer);
+                    // The drop counter of the kernel only grows
+                    socketStats[i].received += 1;
+                    if (info.hasDrops)
+                        socketStats[i].kernelDrops = info.drops;
+                    if (info.queuedNs >= 0)
+                        HistogramRecord(&socketStats[i].queueDelay, info.queuedNs);
                 }
 
-                continue;
-            }
+                long start = ClockNowNs();
+                received = 1;
 
-            if (strcmp(msgBuffer, "DISCONNECT") == 0)
-            {
-                sprintf(notifyBuffer, "Client %s will be disconnected", addrBuffer);
-                NotifyObservers(&library, notifyBuffer);
+                /* null-terminate the received data */
+                msgBuffer[recvMsgSize] = '\0';
 
-                // Check if an observer wants to disconnect
-                Observer obs;
-                obs.addr = clientAddr;
-                if (ListContains(library.observers, &obs, ObserverCompare))
-                {
-                    // Remove observer from list
-                    Observer *obsItem = ListRemove(library.observers, &obs, ObserverCompare);
-                    free(obsItem);
-                }
-                else
-                {
-                    // an worker wants to disconnect
-                }
+                MessageType type = HandleMessage(&library, msgBuffer, &clientAddr);
 
-                continue;
+                HistogramRecord(&library.stats.service[type], ClockNowNs() - start);
             }
+        }
+    } while (received || (shmEnabled && !ShmServerIdle(&shm)));
+    /* Nothing left to receive */
+}
 
-            if (strcmp(msgBuffer, "GIVE_ME_TASK") == 0)
-            {
-                // This is the first message from the worker client
-                sprintf(notifyBuffer, "Client %s requests a task", addrBuffer);
-                NotifyObservers(&library, notifyBuffer);
-            }
+void ServerSend(const char *msg, int msgLen, const Address *addr)
+{
+    // There is one endpoint of each family
+    for (int i = 0; i < endpointCount; ++i)
+    {
+        if (endpoints[i].sa.sa_family == addr->sa.sa_family)
+        {
+            if (socks[i] >= 0)
+                OutQueueSend(&outQueues[i], msg, msgLen, addr);
             else
-            {
-                // This is not the first message.
-                // The client must send the ID of the book found at the position given to it.
-
-                Book b;
-                if (ParseMessage(msgBuffer, &b) == 0)
-                {
-                    // skip invalid message
-                    printf("Warning! Invalid message received: \"%s\"\n", msgBuffer);
-                    continue;
-                }
-
-                // Remove pending task from the list
-                PendingTask pt;
-                pt.task = b.pos;
-                void *item = ListRemove(library.pendingTaskQueue, &pt, TaskCompare);
-                free(item);
-
-                sprintf(notifyBuffer, "Client %s found book %d at position (%d, %d, %d)", addrBuffer, b.id, b.pos.m, b.pos.n, b.pos.k);
-                NotifyObservers(&library, notifyBuffer);
+                ShmServerSend(&shm, msg, msgLen, addr);
+            return;
+        }
+    }
+}
 
-                // Create a new book item and insert it into catalog
-                Book *bookItem = BookCreate(b.id, b.pos.m, b.pos.n, b.pos.k);
-                if (!ListContains(library.catalog, bookItem, BookCompare))
-                {
-                    ListInsert(library.catalog, bookItem, BookCompare);
-                }
+void ServerSendStats(const Address *addr)
+{
+    char buffer[MSGMAX];
+    for (int i = 0; i < endpointCount; ++i)
+    {
+        if (socks[i] >= 0)
+        {
+            const char *name = endpoints[i].sa.sa_family == AF_UNIX ? "unix" : "udp";
+            SocketStats *stats = &socketStats[i];
 
-                // Check if catalog is completely recovered
-                if (ListSize(library.catalog) == library.catalogFullSize)
-                {
-                    library.ready = 1;
-                    PrintCatalog(&library);
-                    NotifyObservers(&library, "NO_MORE_TASKS");
-                }
-            }
+            sprintf(buffer, "%s_rcvbuf=%d %s_sndbuf=%d %s_received=%ld %s_kernel_drops=%u",
+                    name, stats->rcvBufSize, name, stats->sndBufSize, name, stats->received, name, stats->kernelDrops);
+            ServerSend(buffer, strlen(buffer), addr);
 
-            if (ListEmpty(library.taskQueue))
-            {
-                if (library.ready)
-                {
-                    sprintf(msgBuffer, "NO_MORE_TASKS");
-                }
-                else
-                {
-                    sprintf(msgBuffer, "PENDING");
-                }
-            }
-            else
-            {
-                // Extract the next task from the queue
-                Task *task = ListPopFront(library.taskQueue);
-                sprintf(notifyBuffer, "Sending next task (%d, %d, %d) to client %s", task->m, task->n, task->k, addrBuffer);
-                NotifyObservers(&library, notifyBuffer);
-                TaskCreateMessage(msgBuffer, task);
-
-                // Create pending task
-                PendingTask *ptItem = malloc(sizeof(*ptItem));
-                ptItem->task = *task;
-                ptItem->time = time(NULL);
-                free(task);
-                ListPushBack(library.pendingTaskQueue, ptItem);
-            }
+            char histName[32];
+            sprintf(histName, "%s_queue_delay_us", name);
+            HistogramFormat(&stats->queueDelay, histName, 1000, buffer, sizeof(buffer));
+            ServerSend(buffer, strlen(buffer), addr);
 
-            // Send next task
-            SendTo(sock, msgBuffer, strlen(msgBuffer), &clientAddr);
+            OutQueueFormat(&outQueues[i], name, buffer);
+            ServerSend(buffer, strlen(buffer), addr);
         }
-    } while (recvMsgSize >= 0);
-    /* Nothing left to receive */
+    }
 }
 
-// Moves uncompleted tasks from pending queue to task queue
-void UpdateQueues(Library *library)
+int FlushOutQueues()
 {
-    // Temporary block all signals
-    sigset_t sigblock;
-    sigfillset(&sigblock);
-    sigprocmask(SIG_BLOCK, &sigblock, NULL);
-
-    time_t now = time(NULL);
+    int queued = 0;
+    for (int i = 0; i < endpointCount; ++i)
+    {
+        if (socks[i] >= 0)
+            queued += OutQueueFlush(&outQueues[i]);
+    }
+    return queued;
+}
 
-    // Move uncompleted tasks from pending queue to task queue
-    int flag;
-    while (1)
+int ParseEndpoints(char *list)
+{
+    endpointCount = 0;
+    for (char *str = strtok(list, ","); str; str = strtok(NULL, ","))
     {
-        flag = 0;
+        if (endpointCount == MAX_ENDPOINTS || !AddressParseLocal(str, &endpoints[endpointCount]))
+            return 0;
 
-        Node *iter = library->pendingTaskQueue->head;
-        while (iter)
+        // Replies are routed by the family of the client address
+        for (int i = 0; i < endpointCount; ++i)
         {
-            PendingTask *pt = (PendingTask *)iter->payload;
-            if (now - pt->time > 5)
-            {
-                // Reinsert old uncompleted task into task queue
-                Task *task = TaskCreate(pt->task.m, pt->task.n, pt->task.k);
-                ListPushBack(library->taskQueue, task);
-
-                // Remove uncompleted task from pending task queue
-                pt = ListRemove(library->pendingTaskQueue, pt, TaskCompare);
-                free(pt);
-                flag = 1;
-                break;
-            }
-            iter = iter->next;
+            if (endpoints[i].sa.sa_family == endpoints[endpointCount].sa.sa_family)
+                return 0;
         }
-
-        if (flag == 0)
-            break;
+        endpointCount += 1;
     }
-    // Unblock signals
-    sigprocmask(SIG_UNBLOCK, &sigblock, NULL);
+    return endpointCount > 0;
 }
@@ -0,0 +1,284 @@
+#define _DEFAULT_SOURCE
+#include "Shm.h"
+#include <stdio.h>       /* for fprintf() */
+#include <stdlib.h>      /* for exit() */
+#include <string.h>      /* for memcpy() */
+#include <unistd.h>      /* for ftruncate(), close() and getpid() */
+#include <fcntl.h>       /* for O_CREAT and O_RDWR */
+#include <signal.h>      /* for kill() */
+#include <errno.h>       /* for errno */
+#include <time.h>        /* for timespec */
+#include <sys/mman.h>    /* for shm_open() and mmap() */
+#include <sys/stat.h>    /* for fstat() */
+#include <sys/syscall.h> /* for SYS_futex */
+#include <linux/futex.h> /* for FUTEX_WAIT and FUTEX_WAKE */
+
+#define SHM_MAGIC 0x4c696253 /* "LibS" */
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// The futexes are shared between processes, so they are not FUTEX_PRIVATE
+static void FutexWait(atomic_uint *word, unsigned value, int timeoutMs)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT, value, timeoutMs < 0 ? NULL : &timeout, NULL, 0);
+}
+
+static void FutexWake(atomic_uint *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Appends a record, returns 0 if the ring is full. Called by the producer only.
+static int RingPush(ShmRing *ring, unsigned generation, const char *msg, int msgLen)
+{
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == SHM_RING_SIZE)
+        return 0;
+
+    ShmRecord *record = &ring->records[tail & (SHM_RING_SIZE - 1)];
+    if (msgLen > SHM_MSG_MAX - 1)
+        msgLen = SHM_MSG_MAX - 1;
+    record->generation = generation;
+    record->len = msgLen;
+    memcpy(record->msg, msg, msgLen);
+
+    // Sequentially consistent, so that the check of the sleeping flag which follows
+    // cannot be reordered before it
+    atomic_store(&ring->tail, tail + 1);
+    return 1;
+}
+
+// Takes the first record, returns 0 if the ring is empty. Called by the consumer only.
+static int RingPop(ShmRing *ring, unsigned *generation, char *msg, int *msgLen)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+        return 0;
+
+    ShmRecord *record = &ring->records[head & (SHM_RING_SIZE - 1)];
+    int len = record->len < *msgLen ? record->len : *msgLen;
+    memcpy(msg, record->msg, len);
+    *msgLen = len;
+    *generation = record->generation;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+static int RingEmpty(ShmRing *ring)
+{
+    return atomic_load(&ring->head) == atomic_load(&ring->tail);
+}
+
+void ShmServerCreate(ShmServer *server, const Address *localAddr)
+{
+    strcpy(server->name, localAddr->shm.shm_name);
+    server->cursor = 0;
+    memset(server->heartbeatsSeen, 0, sizeof(server->heartbeatsSeen));
+
+    /* The segment of a previous server would have stale rings */
+    shm_unlink(server->name);
+
+    int fd = shm_open(server->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        DieWithError("shm_open() failed");
+    if (ftruncate(fd, sizeof(ShmSegment)) < 0)
+        DieWithError("ftruncate() failed");
+
+    // The new segment is zero-filled: all slots are free and all rings empty
+    server->seg = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (server->seg == MAP_FAILED)
+        DieWithError("mmap() failed");
+    close(fd);
+
+    server->seg->serverPid = getpid();
+    atomic_store(&server->seg->serverAwake, 0);
+    __atomic_store_n(&server->seg->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+void ShmServerDestroy(ShmServer *server)
+{
+    munmap(server->seg, sizeof(ShmSegment));
+    shm_unlink(server->name);
+}
+
+static void ClientAddress(int slot, unsigned generation, Address *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->shm.shm_family = AF_SHM;
+    addr->shm.shm_slot = slot;
+    addr->shm.shm_generation = generation;
+    addr->len = sizeof(addr->shm);
+}
+
+int ShmServerReceive(ShmServer *server, char *msg, int *msgLen, Address *addr)
+{
+    for (int i = 0; i < SHM_SLOTS; ++i)
+    {
+        int s = (server->cursor + i) % SHM_SLOTS;
+        ShmSlot *slot = &server->seg->slots[s];
+        unsigned generation;
+
+        unsigned heartbeats = atomic_load_explicit(&slot->heartbeats, memory_order_relaxed);
+        if (heartbeats != server->heartbeatsSeen[s])
+        {
+            server->heartbeatsSeen[s] = heartbeats;
+            generation = atomic_load_explicit(&slot->generation, memory_order_relaxed);
+            *msgLen = strlen("HEARTBEAT");
+            memcpy(msg, "HEARTBEAT", *msgLen);
+        }
+        else if (!RingPop(&slot->requests, &generation, msg, msgLen))
+        {
+            continue;
+        }
+
+        ClientAddress(s, generation, addr);
+        server->cursor = s + 1;
+        return 1;
+    }
+    return 0;
+}
+
+void ShmServerSend(ShmServer *server, const char *msg, int msgLen, const Address *addr)
+{
+    ShmSlot *slot = &server->seg->slots[addr->shm.shm_slot];
+
+    // The worker has left and the slot may belong to another one now
+    if (atomic_load_explicit(&slot->generation, memory_order_relaxed) != addr->shm.shm_generation)
+        return;
+
+    if (RingPush(&slot->replies, 0, msg, msgLen) && atomic_load(&slot->replies.waiting))
+        FutexWake(&slot->replies.tail);
+}
+
+void ShmServerAwake(ShmServer *server)
+{
+    atomic_store(&server->seg->serverAwake, 1);
+}
+
+int ShmServerIdle(ShmServer *server)
+{
+    atomic_store(&server->seg->serverAwake, 0);
+
+    // A worker which saw the server awake did not signal it
+    for (int s = 0; s < SHM_SLOTS; ++s)
+    {
+        ShmSlot *slot = &server->seg->slots[s];
+        if (!RingEmpty(&slot->requests) || atomic_load(&slot->heartbeats) != server->heartbeatsSeen[s])
+        {
+            atomic_store(&server->seg->serverAwake, 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Claims the slot if its owner is 'from', returns 0 if someone else owns it
+static int ClaimSlot(ShmSlot *slot, int from)
+{
+    return atomic_compare_exchange_strong(&slot->owner, &from, getpid());
+}
+
+void ShmClientAttach(ShmClient *client, const Address *serverAddr)
+{
+    int fd = shm_open(serverAddr->shm.shm_name, O_RDWR, 0);
+    if (fd < 0)
+        DieWithError("shm_open() failed");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(ShmSegment))
+    {
+        fprintf(stderr, "Shared memory '%s' is not a library server segment\n", serverAddr->shm.shm_name);
+        exit(EXIT_FAILURE);
+    }
+
+    client->seg = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (client->seg == MAP_FAILED)
+        DieWithError("mmap() failed");
+    close(fd);
+
+    if (__atomic_load_n(&client->seg->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC)
+    {
+        fprintf(stderr, "Shared memory '%s' is not initialized yet\n", serverAddr->shm.shm_name);
+        exit(EXIT_FAILURE);
+    }
+
+    // Take a free slot, or else the slot of a worker which died without freeing it
+    client->slot = NULL;
+    for (int s = 0; s < SHM_SLOTS && !client->slot; ++s)
+    {
+        if (ClaimSlot(&client->seg->slots[s], 0))
+            client->slot = &client->seg->slots[s];
+    }
+    for (int s = 0; s < SHM_SLOTS && !client->slot; ++s)
+    {
+        int owner = atomic_load(&client->seg->slots[s].owner);
+        if (kill(owner, 0) < 0 && errno == ESRCH && ClaimSlot(&client->seg->slots[s], owner))
+            client->slot = &client->seg->slots[s];
+    }
+    if (!client->slot)
+    {
+        fprintf(stderr, "All %d shared memory slots are taken\n", SHM_SLOTS);
+        exit(EXIT_FAILURE);
+    }
+
+    // Requests still queued by the previous owner keep its generation,
+    // replies to it are ours to discard
+    client->generation = atomic_fetch_add(&client->slot->generation, 1) + 1;
+    atomic_store(&client->slot->replies.head, atomic_load(&client->slot->replies.tail));
+    atomic_store(&client->slot->replies.waiting, 0);
+}
+
+void ShmClientDetach(ShmClient *client)
+{
+    atomic_store(&client->slot->owner, 0);
+    munmap(client->seg, sizeof(ShmSegment));
+}
+
+static void WakeServer(ShmClient *client)
+{
+    if (!atomic_load(&client->seg->serverAwake))
+        kill(client->seg->serverPid, SIGIO);
+}
+
+void ShmClientSend(ShmClient *client, const char *msg, int msgLen)
+{
+    if (RingPush(&client->slot->requests, client->generation, msg, msgLen))
+        WakeServer(client);
+}
+
+void ShmClientHeartbeat(ShmClient *client)
+{
+    atomic_fetch_add(&client->slot->heartbeats, 1);
+    WakeServer(client);
+}
+
+int ShmClientWait(ShmClient *client, int timeoutMs)
+{
+    ShmRing *ring = &client->slot->replies;
+
+    // The server answers within microseconds when it is not busy, sleeping would cost more
+    for (int i = 0; i < SHM_SPIN; ++i)
+    {
+        if (!RingEmpty(ring))
+            return 1;
+    }
+
+    unsigned tail = atomic_load(&ring->tail);
+    atomic_store(&ring->waiting, 1);
+    // A reply pushed before the flag was set did not wake us
+    if (atomic_load(&ring->head) == tail)
+        FutexWait(&ring->tail, tail, timeoutMs);
+    atomic_store(&ring->waiting, 0);
+
+    return !RingEmpty(ring);
+}
+
+int ShmClientReceive(ShmClient *client, char *msg, int *msgLen)
+{
+    unsigned generation;
+    return RingPop(&client->slot->replies, &generation, msg, msgLen);
+}
@@ -0,0 +1,108 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h> /* for atomic_uint */
+#include <sys/types.h> /* for pid_t */
+
+#include "Address.h"
+
+// Shared-memory transport between the server and the workers on its host. The
+// server creates a segment with shm_open(), each worker claims a slot in it and
+// the two exchange messages through a pair of single-producer single-consumer
+// rings. Nothing is copied through the kernel: a sender makes a system call only
+// to wake a peer which has gone to sleep, SIGIO for the server and a futex wake
+// for a worker. Like UDP, a message is dropped if its ring is full.
+
+#define SHM_SLOTS 64      /* Workers attached at the same time */
+#define SHM_RING_SIZE 16  /* Messages a ring holds, a power of two */
+#define SHM_MSG_MAX 256   /* Longest message, including the null byte */
+#define SHM_SPIN 4000     /* Polls of the reply ring before a worker sleeps */
+
+typedef struct ShmRecord
+{
+    unsigned generation; // of the worker which sent the request, unused for replies
+    int len;
+    char msg[SHM_MSG_MAX];
+} ShmRecord;
+
+typedef struct ShmRing
+{
+    _Alignas(64) atomic_uint head; // next record to read, advanced by the consumer
+    _Alignas(64) atomic_uint tail; // next record to write, advanced by the producer
+    atomic_int waiting;            // the consumer sleeps on the tail
+    ShmRecord records[SHM_RING_SIZE];
+} ShmRing;
+
+typedef struct ShmSlot
+{
+    atomic_int owner;        // pid of the worker, 0 if the slot is free
+    atomic_uint generation;  // incremented when a worker claims the slot
+    atomic_uint heartbeats;  // incremented by the worker, it may do so in a signal handler
+    ShmRing requests;        // worker -> server
+    ShmRing replies;         // server -> worker
+} ShmSlot;
+
+typedef struct ShmSegment
+{
+    unsigned magic;         // set once the segment is initialized
+    pid_t serverPid;        // the process woken by SIGIO
+    atomic_int serverAwake; // the server is reading the rings, no wakeup needed
+    ShmSlot slots[SHM_SLOTS];
+} ShmSegment;
+
+// Server side of a segment
+typedef struct ShmServer
+{
+    ShmSegment *seg;
+    char name[SHM_NAME_MAX];
+    int cursor;                          // slot read next, the slots are served in turn
+    unsigned heartbeatsSeen[SHM_SLOTS];  // heartbeat count of each slot already reported
+} ShmServer;
+
+// Worker side of a segment
+typedef struct ShmClient
+{
+    ShmSegment *seg;
+    ShmSlot *slot;
+    unsigned generation;
+} ShmClient;
+
+// Creates the segment, replacing one left by an earlier server
+void ShmServerCreate(ShmServer *server, const Address *localAddr);
+
+// Unmaps and removes the segment
+void ShmServerDestroy(ShmServer *server);
+
+// Takes the next message of any worker, returns 0 if there is none. A heartbeat
+// counted by a worker is received as "HEARTBEAT".
+int ShmServerReceive(ShmServer *server, char *msg, int *msgLen, Address *addr);
+
+// Queues the reply for the worker and wakes it if it sleeps
+void ShmServerSend(ShmServer *server, const char *msg, int msgLen, const Address *addr);
+
+// Marks the server as reading the rings: workers do not signal it meanwhile
+void ShmServerAwake(ShmServer *server);
+
+// Marks the server as sleeping. Returns 0 (and stays awake) if a message
+// arrived in between, it would not be signalled.
+int ShmServerIdle(ShmServer *server);
+
+// Maps the segment of the server and claims a free slot
+void ShmClientAttach(ShmClient *client, const Address *serverAddr);
+
+// Frees the slot and unmaps the segment
+void ShmClientDetach(ShmClient *client);
+
+// Queues the request and signals the server if it sleeps
+void ShmClientSend(ShmClient *client, const char *msg, int msgLen);
+
+// Counts a heartbeat, async-signal-safe
+void ShmClientHeartbeat(ShmClient *client);
+
+// Waits up to timeoutMs (forever if negative) for a reply, returns 0 if none came
+int ShmClientWait(ShmClient *client, int timeoutMs);
+
+// Takes the next reply, returns 0 if there is none
+int ShmClientReceive(ShmClient *client, char *msg, int *msgLen);
+
+#endif
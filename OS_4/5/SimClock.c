@@ -0,0 +1,15 @@
+#include "Clock.h"
+#include "SimClock.h"
+
+// Virtual time of the simulation, advanced by the event loop
+static long simNow = 0;
+
+long ClockNowNs()
+{
+    return simNow;
+}
+
+void SimClockSet(long now)
+{
+    simNow = now;
+}
@@ -0,0 +1,7 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+// Moves the virtual clock returned by ClockNowNs() in the simulator
+void SimClockSet(long now);
+
+#endif
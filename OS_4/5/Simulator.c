@@ -0,0 +1,339 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <stdlib.h>     /* for atoi(), drand48() and exit() */
+#include <string.h>     /* for strcpy() */
+#include <time.h>       /* for clock_gettime() */
+
+#include "Library.h"
+#include "SimClock.h"
+#include "Distribution.h"
+
+// Discrete-event simulation of a recovery: the task, lease and catalog logic of the
+// server (Library.c) runs against the virtual clock of SimClock.c and virtual workers
+// which follow the protocol of Worker.c. The network delays and loses datagrams
+// according to the given distributions. No real time passes between the events.
+
+#define PENDING_RETRY (2 * NS_PER_SEC)  /* Worker sleeps after PENDING, as Worker does */
+#define RETRANSMIT_FIRST (50 * NS_PER_MS) /* Request retransmission delays, as in Worker */
+#define RETRANSMIT_LAST NS_PER_SEC
+#define HEARTBEAT_PERIOD NS_PER_SEC     /* Worker heartbeats, as Worker does */
+#define IDLE_PERIOD (100 * NS_PER_MS)   /* Server runs UpdateQueues this often */
+#define SHUTDOWN_DELAY (5 * NS_PER_SEC) /* Server answers for this long after the recovery */
+#define WORKER_BASE_ADDR 0x0A000000     /* Virtual workers are 10.x.x.x:WORKER_PORT */
+#define WORKER_PORT 10000
+#define TIME_LIMIT (3600 * NS_PER_SEC)  /* Virtual time after which the simulation gives up */
+
+typedef enum EventKind
+{
+    EV_TO_SERVER,  // datagram arrives at the server
+    EV_TO_WORKER,  // datagram arrives at a worker
+    EV_WORKER_WAKE, // worker finished looking for a book or sleeping after PENDING
+    EV_HEARTBEAT,  // worker heartbeat timer
+    EV_RETRANSMIT, // worker retransmission timer
+    EV_IDLE        // server idle time
+} EventKind;
+
+typedef struct Event
+{
+    long at;  // virtual time, ns
+    long seq; // order of the events scheduled for the same time
+    EventKind kind;
+    int worker;
+    int timer; // generation of the retransmission timer
+    char msg[64];
+} Event;
+
+static inline int EventLess(const Event *e1, const Event *e2)
+{
+    return e1->at < e2->at || (e1->at == e2->at && e1->seq < e2->seq);
+}
+
+DEFINE_VECTOR(Events, Event)
+DEFINE_VECTOR_HEAP(Events, Event, EventLess)
+
+typedef enum SimWorkerState
+{
+    WAITING_REPLY, // sent a request, waits for the server
+    BUSY,          // looking for the book
+    SLEEPING,      // got PENDING
+    FINISHED       // got NO_MORE_TASKS
+} SimWorkerState;
+
+typedef struct SimWorker
+{
+    SimWorkerState state;
+    char result[64];  // result to send once the book is found
+    char request[64]; // request waiting for a reply
+    int seq;          // sequence number of the request
+    int timer;        // generation of the retransmission timer, older timers are ignored
+    long retransmitDelay;
+} SimWorker;
+
+Library library;
+Events events;
+SimWorker *workers;
+long eventSeq = 0;
+long now = 0;
+
+Distribution serviceTime = {DIST_UNIFORM, 1000, 3000}; // ms
+Distribution delay = {DIST_FIXED, 0.1, 0};             // ms
+double lossRate = 0;
+
+/* Statistics */
+long toServer = 0, toWorkers = 0, lost = 0, retransmits = 0;
+
+void Schedule(long at, EventKind kind, int worker, const char *msg);
+void ScheduleRetransmit(int worker);
+// Sends the request with the next sequence number and retransmits it until the reply comes
+void SendRequest(int worker, const char *body);
+// Sends the datagram over the virtual network
+void Transmit(EventKind kind, int worker, const char *msg);
+void WorkerAddr(int worker, Address *addr);
+// Sends replies of the library to the virtual workers
+void SimSend(const char *msg, int msgLen, const Address *addr);
+void WorkerReceive(int worker, const char *msg);
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5 || argc > 8)
+    {
+        fprintf(stderr, "Usage: %s <M> <N> <K> <Workers> [<Service Time> [<Loss> [<Delay>]]]\n", argv[0]);
+        fprintf(stderr, "  Service Time, ms: fixed:T | uniform:MIN:MAX (default uniform:1000:3000) | exp:MEAN\n");
+        fprintf(stderr, "  Loss: probability to lose a datagram (default 0)\n");
+        fprintf(stderr, "  Delay: one-way network delay in ms, same syntax as Service Time (default fixed:0.1)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const int M = atoi(argv[1]);
+    const int N = atoi(argv[2]);
+    const int K = atoi(argv[3]);
+    const int workerCount = atoi(argv[4]);
+    if ((argc > 5 && !DistributionParse(argv[5], &serviceTime)) ||
+        (argc > 7 && !DistributionParse(argv[7], &delay)))
+    {
+        fprintf(stderr, "Invalid distribution\n");
+        exit(EXIT_FAILURE);
+    }
+    if (argc > 6)
+        lossRate = atof(argv[6]);
+
+    struct timespec realStart, realEnd;
+    clock_gettime(CLOCK_MONOTONIC, &realStart);
+
+    srand48(1); // runs are reproducible
+    SimClockSet(0);
+    Initialize(&library, M, N, K);
+    library.send = SimSend;
+
+    EventsInit(&events);
+    workers = calloc(workerCount, sizeof(*workers));
+    for (int i = 0; i < workerCount; ++i)
+    {
+        SendRequest(i, "GIVE_ME_TASK");
+        Schedule(HEARTBEAT_PERIOD, EV_HEARTBEAT, i, "");
+    }
+    Schedule(IDLE_PERIOD, EV_IDLE, -1, "");
+
+    long readyAt = -1;
+    int finished = 0;
+    while (events.size > 0 && finished < workerCount && now < TIME_LIMIT)
+    {
+        Event ev = EventsHeapPop(&events);
+        now = ev.at;
+        SimClockSet(now);
+
+        if (readyAt >= 0 && now > readyAt + SHUTDOWN_DELAY)
+            break; // the server has shut down
+
+        switch (ev.kind)
+        {
+        case EV_TO_SERVER:
+        {
+            char msgBuffer[MSGMAX];
+            strcpy(msgBuffer, ev.msg);
+            Address addr;
+            WorkerAddr(ev.worker, &addr);
+            HandleMessage(&library, msgBuffer, &addr);
+            if (library.ready && readyAt < 0)
+                readyAt = now;
+            break;
+        }
+        case EV_TO_WORKER:
+        {
+            SimWorkerState before = workers[ev.worker].state;
+            WorkerReceive(ev.worker, ev.msg);
+            if (before != FINISHED && workers[ev.worker].state == FINISHED)
+                finished += 1;
+            break;
+        }
+        case EV_WORKER_WAKE:
+        {
+            SimWorker *w = &workers[ev.worker];
+            SendRequest(ev.worker, w->state == BUSY ? w->result : "GIVE_ME_TASK");
+            break;
+        }
+        case EV_RETRANSMIT:
+        {
+            SimWorker *w = &workers[ev.worker];
+            if (w->state == WAITING_REPLY && w->timer == ev.timer)
+            {
+                retransmits += 1;
+                Transmit(EV_TO_SERVER, ev.worker, w->request);
+                w->retransmitDelay = w->retransmitDelay * 2 < RETRANSMIT_LAST ? w->retransmitDelay * 2 : RETRANSMIT_LAST;
+                ScheduleRetransmit(ev.worker);
+            }
+            break;
+        }
+        case EV_HEARTBEAT:
+            if (workers[ev.worker].state != FINISHED)
+            {
+                Transmit(EV_TO_SERVER, ev.worker, "HEARTBEAT");
+                Schedule(now + HEARTBEAT_PERIOD, EV_HEARTBEAT, ev.worker, "");
+            }
+            break;
+        case EV_IDLE:
+            UpdateQueues(&library);
+            Schedule(now + IDLE_PERIOD, EV_IDLE, -1, "");
+            break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &realEnd);
+
+    char buffer[MSGMAX];
+    printf("recovered=%d/%d\n", library.catalog.size, library.catalogFullSize);
+    printf("virtual_recovery_s=%.3f\n", readyAt >= 0 ? (double)readyAt / NS_PER_SEC : -1.0);
+    printf("real_s=%.3f\n", (realEnd.tv_sec - realStart.tv_sec) + (realEnd.tv_nsec - realStart.tv_nsec) * 1e-9);
+    printf("datagrams_to_server=%ld\n", toServer);
+    printf("datagrams_to_workers=%ld\n", toWorkers);
+    printf("datagrams_lost=%ld\n", lost);
+    printf("retransmits=%ld\n", retransmits);
+    printf("duplicate_results=%ld\n", library.stats.duplicateResults);
+    printf("duplicate_requests=%ld\n", library.stats.duplicateRequests);
+    printf("requeued=%ld\n", library.stats.requeued);
+    printf("rate_limited=%ld\n", library.stats.rateLimited);
+    printf("overloads=%ld\n", library.stats.overloads);
+    printf("shelf_changes=%ld\n", library.stats.shelfChanges);
+    printf("steals=%ld\n", library.stats.steals);
+    printf("unfinished_workers=%d\n", workerCount - finished);
+    HistogramFormat(&library.stats.lease, "lease_ms", NS_PER_MS, buffer, sizeof(buffer));
+    printf("%s\n", buffer);
+    HistogramFormat(&library.stats.requeue, "requeue_per_pass", 1, buffer, sizeof(buffer));
+    printf("%s\n", buffer);
+
+    free(workers);
+    EventsFree(&events);
+    return EXIT_SUCCESS;
+}
+
+void Schedule(long at, EventKind kind, int worker, const char *msg)
+{
+    Event ev;
+    ev.at = at;
+    ev.seq = eventSeq++;
+    ev.kind = kind;
+    ev.worker = worker;
+    ev.timer = 0;
+    strncpy(ev.msg, msg, sizeof(ev.msg) - 1);
+    ev.msg[sizeof(ev.msg) - 1] = '\0';
+    EventsHeapPush(&events, ev);
+}
+
+void ScheduleRetransmit(int worker)
+{
+    SimWorker *w = &workers[worker];
+    w->timer += 1;
+    Event ev = {now + w->retransmitDelay, eventSeq++, EV_RETRANSMIT, worker, w->timer, ""};
+    EventsHeapPush(&events, ev);
+}
+
+void SendRequest(int worker, const char *body)
+{
+    SimWorker *w = &workers[worker];
+    w->seq += 1;
+    sprintf(w->request, "%s:%d", body, w->seq);
+    w->state = WAITING_REPLY;
+    w->retransmitDelay = RETRANSMIT_FIRST;
+    Transmit(EV_TO_SERVER, worker, w->request);
+    ScheduleRetransmit(worker);
+}
+
+void Transmit(EventKind kind, int worker, const char *msg)
+{
+    if (kind == EV_TO_SERVER)
+        toServer += 1;
+    else
+        toWorkers += 1;
+
+    if (drand48() < lossRate)
+    {
+        lost += 1;
+        return;
+    }
+    Schedule(now + (long)(DistributionSample(&delay) * NS_PER_MS), kind, worker, msg);
+}
+
+void WorkerAddr(int worker, Address *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->in.sin_family = AF_INET;
+    addr->in.sin_addr.s_addr = htonl(WORKER_BASE_ADDR + worker);
+    addr->in.sin_port = htons(WORKER_PORT);
+    addr->len = sizeof(addr->in);
+}
+
+void SimSend(const char *msg, int msgLen, const Address *addr)
+{
+    (void)msgLen; // messages are null-terminated
+    Transmit(EV_TO_WORKER, ntohl(addr->in.sin_addr.s_addr) - WORKER_BASE_ADDR, msg);
+}
+
+void WorkerReceive(int worker, const char *msg)
+{
+    SimWorker *w = &workers[worker];
+    if (w->state != WAITING_REPLY)
+        return;
+
+    int seq;
+    if (sscanf(msg, "ACK %d", &seq) == 1)
+    {
+        // The server has the result, only the reply is missing: retry slowly
+        if (seq == w->seq)
+        {
+            w->retransmitDelay = RETRANSMIT_LAST;
+            ScheduleRetransmit(worker);
+        }
+        return;
+    }
+
+    // Replies end with the sequence number of their request, ignore the stale ones
+    char body[64];
+    const char *colon = strrchr(msg, ':');
+    if (!colon || atoi(colon + 1) != w->seq)
+        return;
+    snprintf(body, sizeof(body), "%.*s", (int)(colon - msg), msg);
+
+    if (strcmp(body, "NO_MORE_TASKS") == 0)
+    {
+        w->state = FINISHED;
+        return;
+    }
+
+    if (strcmp(body, "PENDING") == 0)
+    {
+        w->state = SLEEPING;
+        Schedule(now + PENDING_RETRY, EV_WORKER_WAKE, worker, "");
+        return;
+    }
+
+    Task task;
+    if (TaskParse(body, &task))
+    {
+        // The book ID is derived from the position, every ID is unique
+        int id = PositionIndex(&library, &task) + 1;
+        sprintf(w->result, "%d:%d:%d:%d", id, task.m, task.n, task.k);
+        w->state = BUSY;
+        Schedule(now + (long)(DistributionSample(&serviceTime) * NS_PER_MS), EV_WORKER_WAKE, worker, "");
+    }
+}
@@ -0,0 +1,61 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <sys/socket.h> /* for socket(), connect(), sendto(), and recvfrom() */
+#include <arpa/inet.h>  /* for sockaddr_in and inet_addr() */
+#include <stdlib.h>     /* for atoi() and exit() */
+#include <string.h>     /* for memset() */
+#include <unistd.h>     /* for close() */
+
+#include "IO.h"
+
+#define MSGMAX 255 /* Longest message string */
+
+void DieWithError(char *errorMessage); /* External error handling function */
+
+// Requests the statistics from the server and prints them
+int main(int argc, char *argv[])
+{
+    int sock;                /* Socket descriptor */
+    Address libServAddr;     /* Library server address */
+    Address fromAddr;        /* Source address of response */
+    char buffer[MSGMAX + 1]; /* Buffer for storing message */
+    int msgLen;              /* Length of received response */
+
+    /* Args: server IP address (dotted quad) and port, or its Unix-domain socket */
+    if (AddressFromArgs(argv + 1, argc - 1, &libServAddr) != argc - 1) /* Test for correct number of arguments */
+    {
+        fprintf(stderr, "Usage: %s <Server IP> <Server Port>\n", argv[0]);
+        fprintf(stderr, "       %s unix:<Server Socket Path>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Create a datagram socket of the server's family */
+    sock = CreateClientSocket(&libServAddr);
+
+    SendTo(sock, "STATS", strlen("STATS"), &libServAddr);
+
+    for (;;)
+    {
+        msgLen = MSGMAX;
+        RecvFrom(sock, buffer, &msgLen, &fromAddr);
+
+        if (!AddressFromServer(&libServAddr, &fromAddr))
+        {
+            fprintf(stderr, "Warning: received a packet from unknown source.\n");
+            continue;
+        }
+
+        buffer[msgLen] = '\0';
+
+        if (strcmp(buffer, "END_STATS") == 0)
+        {
+            break;
+        }
+
+        printf("%s\n", buffer);
+    }
+
+    close(sock);
+    exit(EXIT_SUCCESS);
+}
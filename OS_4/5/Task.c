@@ -1,5 +1,5 @@
 #include "Task.h"
-#include <stdio.h>
+#include "Codec.h"
 #include <stdlib.h>
 
 Task *TaskCreate(int m, int n, int k)
@@ -13,14 +13,19 @@ Task *TaskCreate(int m, int n, int k)
 
 int TaskParse(const char *str, Task *task)
 {
-    if (sscanf(str, "%d:%d:%d", &task->m, &task->n, &task->k) != 3)
+    int values[3];
+    if (CodecParseFields(str, ':', values, 3, NULL) != 3)
     {
         return 0;
     }
+    task->m = values[0];
+    task->n = values[1];
+    task->k = values[2];
     return 1;
 }
 
 void TaskCreateMessage(char *str, Task *task)
 {
-    sprintf(str, "%d:%d:%d", task->m, task->n, task->k);
+    int values[3] = {task->m, task->n, task->k};
+    CodecFormatFields(str, ':', values, 3);
 }
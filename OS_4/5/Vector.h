@@ -0,0 +1,199 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Typed dynamic array storing the elements inline in one contiguous block.
+// DEFINE_VECTOR(Name, Type) generates the type Name and the functions Name##Init,
+// Name##Free, Name##Reserve, Name##PushBack, Name##PopBack, Name##Back and Name##Clear.
+#define DEFINE_VECTOR(Name, Type)                                              \
+    typedef struct Name                                                        \
+    {                                                                          \
+        Type *data;                                                            \
+        int size;                                                              \
+        int capacity;                                                          \
+    } Name;                                                                    \
+                                                                               \
+    static inline void Name##Init(Name *v)                                     \
+    {                                                                          \
+        v->data = NULL;                                                        \
+        v->size = 0;                                                           \
+        v->capacity = 0;                                                       \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Free(Name *v)                                     \
+    {                                                                          \
+        free(v->data);                                                         \
+        Name##Init(v);                                                         \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Reserve(Name *v, int capacity)                    \
+    {                                                                          \
+        if (capacity <= v->capacity)                                           \
+            return;                                                            \
+        v->data = realloc(v->data, capacity * sizeof(Type));                   \
+        assert(v->data);                                                       \
+        v->capacity = capacity;                                                \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##PushBack(Name *v, Type item)                     \
+    {                                                                          \
+        if (v->size == v->capacity)                                            \
+            Name##Reserve(v, v->capacity ? 2 * v->capacity : 16);              \
+        v->data[v->size] = item;                                               \
+        return &v->data[v->size++];                                            \
+    }                                                                          \
+                                                                               \
+    static inline Type Name##PopBack(Name *v)                                  \
+    {                                                                          \
+        assert(v->size > 0);                                                   \
+        return v->data[--v->size];                                             \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##Back(Name *v)                                    \
+    {                                                                          \
+        assert(v->size > 0);                                                   \
+        return &v->data[v->size - 1];                                          \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Clear(Name *v)                                    \
+    {                                                                          \
+        v->size = 0;                                                           \
+    }
+
+// Ordered operations over a vector generated by DEFINE_VECTOR.
+// Less(const Type *, const Type *) is expanded inline, so it may be a macro or an inline function.
+// Generates Name##Sort, Name##LowerBound and Name##InsertSorted, which together let a sorted
+// vector serve as a compact ordered map.
+#define DEFINE_VECTOR_ORDER(Name, Type, Less)                                  \
+    static inline void Name##InsertionSort(Type *a, int n)                     \
+    {                                                                          \
+        for (int i = 1; i < n; ++i)                                            \
+        {                                                                      \
+            Type item = a[i];                                                  \
+            int j = i;                                                         \
+            while (j > 0 && Less(&item, &a[j - 1]))                            \
+            {                                                                  \
+                a[j] = a[j - 1];                                               \
+                --j;                                                           \
+            }                                                                  \
+            a[j] = item;                                                       \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void Name##QuickSort(Type *a, int n)                                \
+    {                                                                          \
+        while (n > 16)                                                         \
+        {                                                                      \
+            /* median of three as the pivot */                                 \
+            Type *lo = a, *mid = a + n / 2, *hi = a + n - 1;                   \
+            Type tmp;                                                          \
+            if (Less(mid, lo)) { tmp = *mid; *mid = *lo; *lo = tmp; }          \
+            if (Less(hi, mid)) { tmp = *hi; *hi = *mid; *mid = tmp; }          \
+            if (Less(mid, lo)) { tmp = *mid; *mid = *lo; *lo = tmp; }          \
+            Type pivot = *mid;                                                 \
+            int i = 0, j = n - 1;                                              \
+            for (;;)                                                           \
+            {                                                                  \
+                while (Less(&a[i], &pivot))                                    \
+                    ++i;                                                       \
+                while (Less(&pivot, &a[j]))                                    \
+                    --j;                                                       \
+                if (i >= j)                                                    \
+                    break;                                                     \
+                tmp = a[i]; a[i] = a[j]; a[j] = tmp;                           \
+                ++i;                                                           \
+                --j;                                                           \
+            }                                                                  \
+            /* recurse into the smaller half, loop over the larger one */      \
+            if (j + 1 < n - j - 1)                                             \
+            {                                                                  \
+                Name##QuickSort(a, j + 1);                                     \
+                a += j + 1;                                                    \
+                n -= j + 1;                                                    \
+            }                                                                  \
+            else                                                               \
+            {                                                                  \
+                Name##QuickSort(a + j + 1, n - j - 1);                         \
+                n = j + 1;                                                     \
+            }                                                                  \
+        }                                                                      \
+        Name##InsertionSort(a, n);                                             \
+    }                                                                          \
+                                                                               \
+    static inline void Name##Sort(Name *v)                                     \
+    {                                                                          \
+        Name##QuickSort(v->data, v->size);                                     \
+    }                                                                          \
+                                                                               \
+    /* Index of the first element which is not less than the key */            \
+    static inline int Name##LowerBound(const Name *v, const Type *key)         \
+    {                                                                          \
+        int lo = 0, hi = v->size;                                              \
+        while (lo < hi)                                                        \
+        {                                                                      \
+            int mid = lo + (hi - lo) / 2;                                      \
+            if (Less(&v->data[mid], key))                                      \
+                lo = mid + 1;                                                  \
+            else                                                               \
+                hi = mid;                                                      \
+        }                                                                      \
+        return lo;                                                             \
+    }                                                                          \
+                                                                               \
+    /* Insert keeping the order, returns the inserted element */               \
+    static inline Type *Name##InsertSorted(Name *v, Type item)                 \
+    {                                                                          \
+        int idx = Name##LowerBound(v, &item);                                  \
+        Name##PushBack(v, item);                                               \
+        memmove(&v->data[idx + 1], &v->data[idx], (v->size - 1 - idx) * sizeof(Type)); \
+        v->data[idx] = item;                                                   \
+        return &v->data[idx];                                                  \
+    }
+
+// Binary min-heap over a vector generated by DEFINE_VECTOR, Less is expanded inline.
+// Generates Name##HeapPush, Name##HeapPop and Name##HeapTop.
+#define DEFINE_VECTOR_HEAP(Name, Type, Less)                                   \
+    static inline void Name##HeapPush(Name *v, Type item)                      \
+    {                                                                          \
+        Name##PushBack(v, item);                                               \
+        int i = v->size - 1;                                                   \
+        while (i > 0 && Less(&item, &v->data[(i - 1) / 2]))                    \
+        {                                                                      \
+            v->data[i] = v->data[(i - 1) / 2];                                 \
+            i = (i - 1) / 2;                                                   \
+        }                                                                      \
+        v->data[i] = item;                                                     \
+    }                                                                          \
+                                                                               \
+    static inline Type *Name##HeapTop(Name *v)                                 \
+    {                                                                          \
+        assert(v->size > 0);                                                   \
+        return &v->data[0];                                                    \
+    }                                                                          \
+                                                                               \
+    static inline Type Name##HeapPop(Name *v)                                  \
+    {                                                                          \
+        Type top = v->data[0];                                                 \
+        Type item = Name##PopBack(v);                                          \
+        int i = 0;                                                             \
+        for (;;)                                                               \
+        {                                                                      \
+            int child = 2 * i + 1;                                             \
+            if (child >= v->size)                                              \
+                break;                                                         \
+            if (child + 1 < v->size && Less(&v->data[child + 1], &v->data[child])) \
+                child += 1;                                                    \
+            if (!Less(&v->data[child], &item))                                 \
+                break;                                                         \
+            v->data[i] = v->data[child];                                       \
+            i = child;                                                         \
+        }                                                                      \
+        if (v->size > 0)                                                       \
+            v->data[i] = item;                                                 \
+        return top;                                                            \
+    }
+
+#endif
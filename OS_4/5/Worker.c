@@ -3,49 +3,116 @@
 #include <stdio.h>      /* for printf() and fprintf() */
 #include <sys/socket.h> /* for socket(), connect(), sendto(), and recvfrom() */
 #include <arpa/inet.h>  /* for sockaddr_in and inet_addr() */
-#include <stdlib.h>     /* for atoi(), rand() and exit() */
+#include <stdlib.h>     /* for rand() and exit() */
 #include <time.h>       /* for time()*/
 #include <string.h>     /* for memset() */
 #include <unistd.h>     /* for close() and usleep() */
 #include <signal.h>     /* for signal() and SIGALRM */
+#include <errno.h>      /* for errno */
+#include <sys/time.h>   /* for setitimer() */
+#include <poll.h>       /* for poll() */
 
 #include "Book.h"
+#include "BookIndex.h"
 #include "Task.h"
+#include "Codec.h"
+#include "RowRange.h"
+#include "Clock.h"
 #include "IO.h"
+#include "Shm.h"
 
 #define MSGMAX 255 /* Longest message string */
+#define HEARTBEAT_PERIOD 1 /* Seconds between heartbeats sent to the server */
+
+#define RETRANSMIT_FIRST_MS 50   /* First retransmission delay, doubled after each retry */
+#define RETRANSMIT_LAST_MS 1000  /* Longest retransmission delay */
+#define MAX_PARTITIONS 32        /* Partition servers a coordinator may redirect to */
+#define ROW_LIST_MAX (MSGMAX - 13 - CODEC_INT_MAX - 1) /* Longest row list of "GIVE_ME_TASK:SEQ ROWS" */
+
+// Request sent to the server and not answered yet. The worker sends its next
+// request only after the reply, so there is at most one.
+typedef struct OutstandingRequest
+{
+    int seq; // 0 if there is no request
+    char msg[MSGMAX + 1];
+    long retryAt; // ns
+    int delayMs;  // delay before the next retry
+} OutstandingRequest;
 
 void SIGINTHandler(int);
+void SIGALRMHandler(int);
+// Sleep for the given number of milliseconds, resuming after signals
+void SleepMs(int ms);
 
 void DieWithError(char *errorMessage); /* External error handling function */
-// Parse the book from one line of the input file
-void ParseBook(char *line, Book *book);
-// Find the book in the input file by the given position (task)
-int FindBook(const char *filename, const Task *task, Book *book);
-
-int sock;                       /* Socket descriptor - GLOBAL for SIGINTHandler */
-struct sockaddr_in libServAddr; /* Library server address - GLOBAL for SIGINTHandler */
+// Load the input file into the index, exits if it is empty or invalid
+void LoadLibraryFile(const char *filename, BookIndex *index);
+// Find the book in the index of the input file by the given position (task)
+int FindBook(const BookIndex *index, const Task *task, Book *book);
+// List the rows of the input files for the task requests
+void CreateRowList(char *rowList, const RowRange *fileRows, int fileCount);
+// Send the request with the next sequence number, it is retransmitted until the reply comes
+void SendRequest(const char *body);
+// Ask for a task, listing our rows
+void SendTaskRequest();
+// Wait until a reply arrives, retransmitting the outstanding request meanwhile
+void WaitForReply();
+// Send the message over the transport of the server
+void SendToServer(const char *msg);
+// Take the reply which has arrived, returns 0 if it comes from an unknown source
+int ReceiveFromServer(char *msg, int *msgLen);
+// Switch to the server at the address, replacing the socket or shared-memory slot
+void ConnectToServer(const Address *addr);
+
+int sock;            /* Socket descriptor - GLOBAL for SIGINTHandler */
+Address libServAddr; /* Library server address - GLOBAL for SIGINTHandler */
+ShmClient shm;       /* Slot in the shared memory of the server - GLOBAL for SIGINTHandler */
+int shmEnabled;      /* The server is reached through shared memory instead of sock */
+int connected;       /* sock or shm is open */
+
+// A coordinator redirects the worker to the partition server of its rows,
+// the worker comes back when the partition is complete
+Address homeAddr;                     /* Server given on the command line */
+Address completeAddrs[MAX_PARTITIONS]; /* Partitions which have answered NO_MORE_TASKS */
+int completeCount;
+
+char rowList[MSGMAX + 1];   /* Rows of the library files, e.g. "0-3,8-11" */
+OutstandingRequest request; /* Retransmit buffer */
+int nextSeq = 1;            /* Sequence number of the next request */
 
 int main(int argc, char *argv[])
 {
-    struct sockaddr_in fromAddr; /* Source address of response */
-    unsigned short libServPort;  /* Library server port */
-    char *servIP;                /* IP address of server */
-    char *libFilename;           /* Filename containing positions of the books in the library */
-    char outBuffer[MSGMAX + 1];  /* Buffer for storing request */
+    int addrArgs;                /* Arguments taken by the server address */
+    char **libFilenames;         /* Files containing positions of the books in the library (shards) */
+    int libFileCount;            /* Number of the files */
+    BookIndex *fileIndexes;      /* Books of each file */
+    RowRange *fileRows;          /* Rows stored in each file */
     char inBuffer[MSGMAX + 1];   /* Buffer for receiving response */
     int responseLen;             /* Length of received response */
     struct sigaction handler;    /* Signal handling action definition */
 
-    if (argc != 4) /* Test for correct number of arguments */
+    /* First args: server IP address (dotted quad) and port, or its Unix-domain socket */
+    addrArgs = AddressFromArgs(argv + 1, argc - 1, &libServAddr);
+    if (addrArgs == 0 || argc < 2 + addrArgs) /* Test for correct number of arguments */
     {
-        fprintf(stderr, "Usage: %s <Server IP> <Server Port> <Library Filename>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <Server IP> <Server Port> <Library Filename>...\n", argv[0]);
+        fprintf(stderr, "       %s unix:<Server Socket Path> <Library Filename>...\n", argv[0]);
+        fprintf(stderr, "       %s shm:<Server Segment Name> <Library Filename>...\n", argv[0]);
+        fprintf(stderr, "  The files may be shards of the library, the worker gets tasks only from their rows\n");
         exit(EXIT_FAILURE);
     }
 
-    servIP = argv[1];            /* First arg: server IP address (dotted quad) */
-    libServPort = atoi(argv[2]); /* Second arg: server port */
-    libFilename = argv[3];       /* Third arg */
+    libFilenames = argv + 1 + addrArgs; /* Other args */
+    libFileCount = argc - 1 - addrArgs;
+
+    fileIndexes = malloc(libFileCount * sizeof(*fileIndexes));
+    fileRows = malloc(libFileCount * sizeof(*fileRows));
+    for (int i = 0; i < libFileCount; ++i)
+    {
+        LoadLibraryFile(libFilenames[i], &fileIndexes[i]);
+        fileRows[i] = fileIndexes[i].rows;
+    }
+    CreateRowList(rowList, fileRows, libFileCount);
 
     /* Set signal handler for SIGTERM */
     handler.sa_handler = SIGINTHandler;
@@ -58,26 +125,34 @@ int main(int argc, char *argv[])
     if (sigaction(SIGINT, &handler, 0) < 0)
         DieWithError("sigaction() failed for SIGINT");
 
-    /* Create a datagram/UDP socket */
-    if ((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
-        DieWithError("socket() failed");
+    /* Set signal handler for SIGALRM, blocking calls are restarted after it */
+    handler.sa_handler = SIGALRMHandler;
+    handler.sa_flags = SA_RESTART;
 
-    /* Construct the server address structure */
-    memset(&libServAddr, 0, sizeof(libServAddr));    /* Zero out structure */
-    libServAddr.sin_family = AF_INET;                /* Internet addr family */
-    libServAddr.sin_addr.s_addr = inet_addr(servIP); /* Server IP address */
-    libServAddr.sin_port = htons(libServPort);       /* Server port */
+    if (sigaction(SIGALRM, &handler, 0) < 0)
+        DieWithError("sigaction() failed for SIGALRM");
 
-    // Send initial message "GIVE_ME_TASK"
-    sprintf(outBuffer, "GIVE_ME_TASK");
-    SendTo(sock, outBuffer, strlen(outBuffer), &libServAddr);
+    /* Create a datagram socket of the server's family, or take a shared-memory slot */
+    homeAddr = libServAddr;
+    ConnectToServer(&homeAddr);
+
+    // Send initial message "GIVE_ME_TASK:<seq> <rows>"
+    SendTaskRequest();
+
+    // Let the server know we are alive while looking for the books
+    struct itimerval heartbeat;
+    heartbeat.it_interval.tv_sec = HEARTBEAT_PERIOD;
+    heartbeat.it_interval.tv_usec = 0;
+    heartbeat.it_value = heartbeat.it_interval;
+    if (setitimer(ITIMER_REAL, &heartbeat, NULL) < 0)
+        DieWithError("setitimer() failed");
 
     for (;;)
     {
-        responseLen = MSGMAX;
-        RecvFrom(sock, inBuffer, &responseLen, &fromAddr);
+        WaitForReply();
 
-        if (libServAddr.sin_addr.s_addr != fromAddr.sin_addr.s_addr)
+        responseLen = MSGMAX;
+        if (!ReceiveFromServer(inBuffer, &responseLen))
         {
             fprintf(stderr, "Warning: received a packet from unknown source.\n");
             continue;
@@ -85,18 +160,73 @@ int main(int argc, char *argv[])
 
         inBuffer[responseLen] = '\0';
 
+        int seq;
+        if (strncmp(inBuffer, "ACK ", 4) == 0 && CodecParseInt(inBuffer + 4, &seq))
+        {
+            // The server has the result, only its reply is missing: retry slowly
+            if (seq == request.seq)
+            {
+                request.delayMs = RETRANSMIT_LAST_MS;
+                request.retryAt = ClockNowNs() + request.delayMs * NS_PER_MS;
+            }
+            continue;
+        }
+
+        // Replies end with the sequence number of their request,
+        // the stale ones answer retransmissions which were already answered
+        char *colon = strrchr(inBuffer, ':');
+        if (!colon || !CodecParseInt(colon + 1, &seq) || seq != request.seq)
+        {
+            continue;
+        }
+        *colon = '\0';
+        request.seq = 0;
+
         if (strcmp(inBuffer, "NO_MORE_TASKS") == 0)
         {
-            break;
+            if (AddressEqual(&libServAddr, &homeAddr))
+                break;
+
+            // The partition is complete, ask the coordinator for another one
+            if (completeCount < MAX_PARTITIONS)
+                completeAddrs[completeCount++] = libServAddr;
+            ConnectToServer(&homeAddr);
+            SendTaskRequest();
+            continue;
+        }
+
+        if (strncmp(inBuffer, "REDIRECT ", 9) == 0)
+        {
+            Address addr;
+            if (!AddressParse(inBuffer + 9, &addr))
+            {
+                fprintf(stderr, "Invalid redirect to '%s'\n", inBuffer + 9);
+                break;
+            }
+
+            int complete = 0;
+            for (int i = 0; i < completeCount && !complete; ++i)
+                complete = AddressEqual(&addr, &completeAddrs[i]);
+            if (complete)
+            {
+                // The coordinator has not learnt yet that the partition is complete
+                SleepMs(2000);
+                SendTaskRequest();
+                continue;
+            }
+
+            printf("Redirected to %s\n", inBuffer + 9);
+            ConnectToServer(&addr);
+            SendTaskRequest();
+            continue;
         }
 
         if (strcmp(inBuffer, "PENDING") == 0)
         {
-            sleep(2); // Wait for 2 sec
+            SleepMs(2000); // Wait for 2 sec
 
-            // Re-Send initial message "GIVE_ME_TASK"
-            sprintf(outBuffer, "GIVE_ME_TASK");
-            SendTo(sock, outBuffer, strlen(outBuffer), &libServAddr);
+            // Re-Send initial message "GIVE_ME_TASK:<seq> <rows>"
+            SendTaskRequest();
 
             continue;
         }
@@ -107,15 +237,29 @@ int main(int argc, char *argv[])
 
         printf("Received task: (%d, %d, %d)\n", task.m, task.n, task.k);
 
+        // Find the file holding the row
+        int file = 0;
+        while (file < libFileCount && !RowRangesContain(&fileRows[file], 1, task.m))
+            ++file;
+        if (file == libFileCount)
+        {
+            // The server has forgotten our rows (e.g. after a timeout), remind it
+            printf("  Row %d is not in the library files\n", task.m);
+            SendTaskRequest();
+            continue;
+        }
+
         Book book;
 
         // Find the book ID in the input file
-        if (FindBook(libFilename, &task, &book))
+        if (FindBook(&fileIndexes[file], &task, &book))
         {
             printf("  Book %d found at (%d, %d, %d)\n", book.id, task.m, task.n, task.k);
-            sprintf(outBuffer, "%d:%d:%d:%d", book.id, book.pos.m, book.pos.n, book.pos.k);
             // Send found book to the server
-            SendTo(sock, outBuffer, strlen(outBuffer), &libServAddr);
+            char result[MSGMAX + 1];
+            int fields[4] = {book.id, book.pos.m, book.pos.n, book.pos.k};
+            CodecFormatFields(result, ':', fields, 4);
+            SendRequest(result);
         }
         else
         {
@@ -126,58 +270,220 @@ int main(int argc, char *argv[])
 
     printf("The worker is shutting down.\n");
 
-    close(sock);
+    for (int i = 0; i < libFileCount; ++i)
+        BookIndexFree(&fileIndexes[i]);
+    free(fileIndexes);
+    free(fileRows);
+    if (shmEnabled)
+        ShmClientDetach(&shm);
+    else
+        close(sock);
     exit(EXIT_SUCCESS);
 }
 
-void ParseBook(char *line, Book *book)
+void LoadLibraryFile(const char *filename, BookIndex *index)
 {
-    if (sscanf(line, "%d:%d:%d:%d", &book->pos.m, &book->pos.n, &book->pos.k, &book->id) != 4)
+    // The file is parsed on all the processors
+    long start = ClockNowNs();
+    long books = BookIndexLoad(index, filename, sysconf(_SC_NPROCESSORS_ONLN));
+    long ns = ClockNowNs() - start;
+
+    if (books == 0)
+    {
+        fprintf(stderr, "Library file '%s' is empty\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (books < 0)
     {
-        fprintf(stderr, "Invalid file format\n");
+        fprintf(stderr, "Invalid file format of '%s'\n", filename);
         exit(EXIT_FAILURE);
     }
+    printf("Loaded %ld books of rows %d-%d from '%s' in %.1f ms\n",
+           books, index->rows.first, index->rows.last, filename, ns / 1e6);
+}
+
+int FindBook(const BookIndex *index, const Task *task, Book *book)
+{
+    int result = BookIndexFind(index, task, book);
+
+    // Generate a random delay from 1000 to 3000 ms
+    srand(time(NULL));
+    int ms = 1000 + rand() % 2001;
+    SleepMs(ms);
+
+    return result;
+}
+
+static int RowRangeCompare(const void *a, const void *b)
+{
+    return ((const RowRange *)a)->first - ((const RowRange *)b)->first;
 }
 
-int FindBook(const char *filename, const Task *task, Book *book)
+void CreateRowList(char *rowList, const RowRange *fileRows, int fileCount)
 {
-    int result = 0;
+    // Merge the rows of the files into as few ranges as possible
+    RowRange *rows = malloc(fileCount * sizeof(*rows));
+    memcpy(rows, fileRows, fileCount * sizeof(*rows));
+    qsort(rows, fileCount, sizeof(*rows), RowRangeCompare);
 
-    // Open file for reading
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL)
+    int count = 0;
+    for (int i = 0; i < fileCount; ++i)
     {
-        fprintf(stderr, "Unable to open file '%s'\n", filename);
+        if (count > 0 && rows[i].first <= rows[count - 1].last + 1)
+        {
+            if (rows[i].last > rows[count - 1].last)
+                rows[count - 1].last = rows[i].last;
+        }
+        else
+        {
+            rows[count++] = rows[i];
+        }
+    }
+
+    if (count > MAX_ROW_RANGES)
+    {
+        fprintf(stderr, "The library files hold more than %d separate row ranges\n", MAX_ROW_RANGES);
+        exit(EXIT_FAILURE);
+    }
+
+    if (RowRangesFormat(rowList, ROW_LIST_MAX + 1, rows, count) < 0)
+    {
+        fprintf(stderr, "The row list of the library files is longer than %d characters\n", ROW_LIST_MAX);
+        exit(EXIT_FAILURE);
+    }
+    free(rows);
+}
+
+// Sends the request just written to the buffer, the first retry comes soon
+static void StartRequest()
+{
+    request.delayMs = RETRANSMIT_FIRST_MS;
+    request.retryAt = ClockNowNs() + request.delayMs * NS_PER_MS;
+    SendToServer(request.msg);
+}
+
+void SendRequest(const char *body)
+{
+    request.seq = nextSeq++;
+    char *end = stpcpy(request.msg, body);
+    *end++ = ':';
+    CodecFormatInt(end, request.seq);
+    StartRequest();
+}
+
+void SendTaskRequest()
+{
+    // The sequence number follows the command, the rows come last
+    request.seq = nextSeq++;
+    int len = snprintf(request.msg, sizeof(request.msg), "GIVE_ME_TASK:%d %s", request.seq, rowList);
+    if (len < 0 || len > MSGMAX)
+    {
+        fprintf(stderr, "The task request does not fit into a message\n");
         exit(EXIT_FAILURE);
     }
+    StartRequest();
+}
 
-    char line[MSGMAX + 1];
+void WaitForReply()
+{
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
 
-    // Check each line in the input file
-    while (fgets(line, MSGMAX + 1, fp))
+    for (;;)
     {
-        ParseBook(line, book);
-        if (book->pos.m == task->m && book->pos.n == task->n && book->pos.k == task->k)
+        long now = ClockNowNs();
+        int timeoutMs = -1;
+
+        if (request.seq)
         {
-            // Book found
-            result = 1;
-            break;
+            if (request.retryAt <= now)
+            {
+                SendToServer(request.msg);
+                request.delayMs = request.delayMs * 2 < RETRANSMIT_LAST_MS ? request.delayMs * 2 : RETRANSMIT_LAST_MS;
+                request.retryAt = now + request.delayMs * NS_PER_MS;
+            }
+            timeoutMs = (request.retryAt - now + NS_PER_MS - 1) / NS_PER_MS;
         }
+
+        // Heartbeats interrupt poll() and the futex wait, the timeout is recomputed then
+        if (shmEnabled ? ShmClientWait(&shm, timeoutMs) : poll(&pfd, 1, timeoutMs) > 0)
+            return;
     }
+}
 
-    fclose(fp);
+void SendToServer(const char *msg)
+{
+    if (shmEnabled)
+        ShmClientSend(&shm, msg, strlen(msg));
+    else
+        SendTo(sock, msg, strlen(msg), &libServAddr);
+}
 
-    // Generate a random delay from 1000 to 3000 ms
-    srand(time(NULL));
-    int ms = 1000 + rand() % 2001;
-    usleep(ms * 1000);
+void ConnectToServer(const Address *addr)
+{
+    // Heartbeats are sent from SIGALRM, keep them off the half-switched transport
+    sigset_t alarmSet;
+    sigemptyset(&alarmSet);
+    sigaddset(&alarmSet, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarmSet, NULL);
 
-    return result;
+    if (connected)
+    {
+        if (shmEnabled)
+            ShmClientDetach(&shm);
+        else
+            close(sock);
+    }
+
+    libServAddr = *addr;
+    shmEnabled = libServAddr.sa.sa_family == AF_SHM;
+    if (shmEnabled)
+        ShmClientAttach(&shm, &libServAddr);
+    else
+        sock = CreateClientSocket(&libServAddr);
+    connected = 1;
+
+    sigprocmask(SIG_UNBLOCK, &alarmSet, NULL);
+}
+
+int ReceiveFromServer(char *msg, int *msgLen)
+{
+    Address fromAddr; /* Source address of response */
+
+    if (shmEnabled)
+        return ShmClientReceive(&shm, msg, msgLen);
+
+    RecvFrom(sock, msg, msgLen, &fromAddr);
+    return AddressFromServer(&libServAddr, &fromAddr);
+}
+
+void SleepMs(int ms)
+{
+    struct timespec delay;
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&delay, &delay) < 0 && errno == EINTR)
+        ;
+}
+
+void SIGALRMHandler(int signalType)
+{
+    (void)signalType;
+    int savedErrno = errno;
+    if (shmEnabled)
+        ShmClientHeartbeat(&shm);
+    else
+        sendto(sock, "HEARTBEAT", strlen("HEARTBEAT"), 0, &libServAddr.sa, libServAddr.len);
+    errno = savedErrno;
 }
 
 void SIGINTHandler(int signalType)
 {
+    (void)signalType;
     printf("\nSIGINT received, notify the server.\n");
-    SendTo(sock, "DISCONNECT", strlen("DISCONNECT"), &libServAddr);
+    SendToServer("DISCONNECT");
+    if (shmEnabled)
+        ShmClientDetach(&shm);
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,99 @@
+#!/bin/bash
+# End-to-end recovery benchmark over the protocol stages.
+#
+# For every stage and library size: generates the library, starts the stage's
+# Server and a fleet of workers on loopback and waits until the server prints
+# the recovered catalog. Writes one CSV line per run:
+#   stage     - protocol stage (directory name)
+#   size      - library size MxNxK
+#   workers   - number of worker processes
+#   wall_s    - time from the server start to the full catalog recovery
+#   datagrams - UDP datagrams sent on the host during the run (from /proc/net/snmp,
+#               so the host should be otherwise quiet)
+#   cpu_s     - server CPU time (user + system) at recovery
+#   rss_kb    - server peak resident set size (VmHWM) at recovery
+#   recovered - 1 if the catalog was recovered before the timeout
+#
+# Usage: bench.sh <report.csv> <stages> <sizes> <workers> <timeout seconds>
+#   e.g. bench.sh bench.csv "1 2 3 4 5" "2x2x2 3x3x3" 4 300
+
+REPORT=${1:-bench.csv}
+STAGES=${2:-"1 2 3 4 5"}
+SIZES=${3:-"2x2x2"}
+WORKERS=${4:-4}
+TIMEOUT=${5:-300}
+PORT=${BENCH_PORT:-41000}
+
+cd "$(dirname "$0")" || exit 1
+CLK_TCK=$(getconf CLK_TCK)
+
+# Total UDP datagrams sent by the host
+udp_out() {
+    awk '/^Udp:/ { if (header) { print $5; exit } header = 1 }' /proc/net/snmp
+}
+
+now() {
+    date +%s.%N
+}
+
+# Prints the difference of two timestamps
+elapsed() {
+    awk -v a="$1" -v b="$2" 'BEGIN { printf "%.3f", b - a }'
+}
+
+echo "stage,size,workers,wall_s,datagrams,cpu_s,rss_kb,recovered" > "$REPORT"
+
+for stage in $STAGES; do
+    # The first stage calls its worker "Client"
+    worker=./Worker
+    [ -x "$stage/Worker" ] || worker=./Client
+
+    for size in $SIZES; do
+        IFS=x read -r M N K <<< "$size"
+        PORT=$((PORT + 1))
+        dir=$(mktemp -d)
+
+        (cd "$stage" && ./Generator "$M" "$N" "$K" "$dir/lib.txt" > /dev/null)
+
+        out0=$(udp_out)
+        start=$(now)
+
+        # Line buffered output lets us see the catalog as soon as it is printed
+        (cd "$stage" && exec stdbuf -oL ./Server "$PORT" "$M" "$N" "$K" > "$dir/server.log" 2>&1) &
+        server=$!
+        sleep 0.2
+
+        pids=""
+        for i in $(seq "$WORKERS"); do
+            (cd "$stage" && exec "$worker" 127.0.0.1 "$PORT" "$dir/lib.txt" > /dev/null 2>&1) &
+            pids="$pids $!"
+        done
+
+        recovered=0
+        while [ "$(elapsed "$start" "$(now)" | cut -d. -f1)" -lt "$TIMEOUT" ] && kill -0 "$server" 2> /dev/null; do
+            if grep -q "The recovered catalog is:" "$dir/server.log"; then
+                recovered=1
+                break
+            fi
+            sleep 0.02
+        done
+        finish=$(now)
+
+        # Server resources at the moment of recovery
+        cpu=0
+        rss=0
+        if [ -r "/proc/$server/stat" ]; then
+            cpu=$(awk -v hz="$CLK_TCK" '{ printf "%.3f", ($14 + $15) / hz }' "/proc/$server/stat")
+            rss=$(awk '/^VmHWM:/ { print $2 }' "/proc/$server/status")
+        fi
+
+        kill $pids "$server" 2> /dev/null
+        wait 2> /dev/null
+        out1=$(udp_out)
+
+        wall=$(elapsed "$start" "$finish")
+        echo "$stage,$size,$WORKERS,$wall,$((out1 - out0)),$cpu,$rss,$recovered" | tee -a "$REPORT"
+
+        rm -rf "$dir"
+    done
+done